@@ -0,0 +1,651 @@
+//--------------------------------------------
+// benchmark.cpp
+//
+// stand alone timing harness, built separately from the report:
+//   g++ -std=c++17 -O2 -pthread benchmark.cpp node.cpp shelf.cpp warehouse.cpp
+//       block_reader.cpp report_writer.cpp date.cpp shard.cpp report_format.cpp
+//       perf_counters.cpp sketch.cpp -o benchmark
+// (add -DREPORTS_ZLIB -DREPORTS_ZSTD ... -lz -lzstd for compressed logs, see block_reader.h)
+//
+// usage: benchmark <name> [arguments]
+//   io <log file> [repeats] - reads, parses and writes the log the old way (ifstream,
+//                             getline, std::cout with std::endl) and through block_reader
+//                             and report_writer, and compares the two
+//   compressed <log file> <compressed copy>... [repeats]
+//                           - reads and parses the plain log and each compressed copy of
+//                             it through block_reader, to check decompressing on the
+//                             helper thread keeps up with parsing
+//   formats [products] [repeats] - writes a made up report of that many products (one
+//                             million by default) in every output format
+//   transfer [products] [repeats] - moves stock between warehouses with Transfer
+//                             (warehouse::transferToShelf) and with the request and receive
+//                             pair it replaces
+//   counters [products] [days] - runs made up days of receives, requests, transfers and
+//                             next days through 8 warehouses and prints the hardware
+//                             counters of each (see perf_counters.h); ./report --counters
+//                             does the same for a real log
+//   horizon [days] [products a day] [keep] - runs a long log whose products keep changing
+//                             (new upc codes every day, each stocked for a few days) and
+//                             prints advanceDay's time per day and the shelf counts every
+//                             tenth of the way; with emptied shelves reclaimed both stay
+//                             flat, with keep (warehouse::keepEmptyShelves) they grow
+//   drain [lots] [repeats] - times a request emptying a shelf of 1024, 4096, ... up to lots
+//                             lots (one million by default), once while the thread's spare
+//                             node list has room for them and once while it is full (see
+//                             node::spare_limit), when every node is deleted one at a time
+//   sketch [updates] [products] - times heavy_hitters::add on a skewed stream of upc codes,
+//                             checks its top list against exact totals, and times
+//                             requestToShelf without and with the sketches (see sketch.h)
+//--------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "block_reader.h"
+#include "report_writer.h"
+#include "report_format.h"
+#include "date.h"
+#include "warehouse.h"
+#include "node.h"
+#include "perf_counters.h"
+#include "sketch.h"
+
+// elapsed - milliseconds since start
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//--- io ---//
+
+// echo_handler - turns every record into a report sized line of output
+// Out is std::ostream for the old path and reports::report_writer for the new one
+template <class Out>
+struct echo_handler
+{
+  Out& out;
+  long long records;
+
+  echo_handler(Out& i_out) : out(i_out), records(0)
+  {
+  }
+
+  void foodItem(std::string_view upc, int, std::string_view name)
+  {
+    records++;
+    line(upc, name);
+  }
+
+  void warehouse(std::string_view name)
+  {
+    records++;
+    line(name, name);
+  }
+
+  void start(std::string_view, std::string_view, std::string_view)
+  {
+    records++;
+  }
+
+  void receive(std::string_view upc, int, std::string_view name)
+  {
+    records++;
+    line(upc, name);
+  }
+
+  void request(std::string_view upc, int, std::string_view name)
+  {
+    records++;
+    line(upc, name);
+  }
+
+  void transfer(std::string_view upc, int, std::string_view names, std::size_t)
+  {
+    records++;
+    line(upc, names);
+  }
+
+  void nextDay()
+  {
+    records++;
+  }
+
+  void line(std::string_view a, std::string_view b);
+};
+
+// the old path flushes every line
+template <>
+void echo_handler<std::ostream>::line(std::string_view a, std::string_view b)
+{
+  out << a << " " << b << std::endl;
+}
+
+template <>
+void echo_handler<reports::report_writer>::line(std::string_view a, std::string_view b)
+{
+  out << a << " " << b << '\n';
+}
+
+// iostream_pass - ifstream/getline in, std::cout/std::endl out (redirected to sink)
+static long long iostream_pass(const std::string& fileName, const std::string& sink)
+{
+  std::ofstream file(sink.c_str());
+  std::streambuf* saved = std::cout.rdbuf(file.rdbuf());
+
+  std::ostream& out = std::cout;
+  echo_handler<std::ostream> handler(out);
+  std::ifstream readFile(fileName.c_str());
+  std::string line;
+  while (std::getline(readFile, line))
+    if (!reports::parse_record<reports::standard_format>(line, handler))
+      break;
+
+  std::cout.rdbuf(saved);
+  return handler.records;
+}
+
+// block_pass - block_reader in, report_writer out
+static long long block_pass(const std::string& fileName, const std::string& sink, bool allowUring)
+{
+  int fd = open(sink.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  long long records = 0;
+  {
+    reports::report_writer out(fd);
+    echo_handler<reports::report_writer> handler(out);
+    reports::block_reader readFile(fileName, 1 << 20, allowUring);
+    std::string_view line;
+    while (readFile.getline(line))
+      if (!reports::parse_record<reports::standard_format>(line, handler))
+	break;
+    records = handler.records;
+  }
+  close(fd);
+  return records;
+}
+
+static int bench_io(int argc, char* argv[])
+{
+  if (argc < 3)
+    {
+      std::cout << "usage: benchmark io <log file> [repeats]" << std::endl;
+      return 1;
+    }
+  std::string fileName = argv[2];
+  int repeats = argc > 3 ? atoi(argv[3]) : 5;
+  std::string sink = "benchmark_io.out";
+
+  double best[3] = { 1e300, 1e300, 1e300 };
+  long long records[3] = { 0, 0, 0 };
+  for (int r = 0; r < repeats; r++)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      records[0] = iostream_pass(fileName, sink);
+      best[0] = std::min(best[0], elapsed(start));
+
+      start = std::chrono::steady_clock::now();
+      records[1] = block_pass(fileName, sink, false);
+      best[1] = std::min(best[1], elapsed(start));
+
+      start = std::chrono::steady_clock::now();
+      records[2] = block_pass(fileName, sink, true);
+      best[2] = std::min(best[2], elapsed(start));
+    }
+  std::remove(sink.c_str());
+
+  const char* names[3] = { "ifstream + cout/endl", "pread thread + writer", "io_uring + writer" };
+  for (int i = 0; i < 3; i++)
+    std::printf("%-24s %10.3f ms  %lld records  %.2fx\n", names[i], best[i], records[i], best[0] / best[i]);
+  return 0;
+}
+
+//--- compressed ---//
+
+static int bench_compressed(int argc, char* argv[])
+{
+  if (argc < 4)
+    {
+      std::cout << "usage: benchmark compressed <log file> <compressed copy>... [repeats]" << std::endl;
+      return 1;
+    }
+
+  // a last argument which is a number is the repeat count
+  int repeats = 5;
+  int last = argc;
+  if (atoi(argv[argc - 1]) > 0 && std::string(argv[argc - 1]).find_first_not_of("0123456789") == std::string::npos)
+    {
+      repeats = atoi(argv[argc - 1]);
+      last--;
+    }
+  std::string sink = "benchmark_compressed.out";
+
+  double plain = 0;
+  for (int f = 2; f < last; f++)
+    {
+      double best = 1e300;
+      long long records = 0;
+      for (int r = 0; r < repeats; r++)
+	{
+	  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	  records = block_pass(argv[f], sink, false);
+	  best = std::min(best, elapsed(start));
+	}
+      if (f == 2)
+	plain = best;
+
+      reports::block_reader probe(argv[f]);
+      std::printf("%-32s %-5s %10.3f ms  %lld records  %.2fx\n", argv[f], probe.compression(), best, records, plain / best);
+    }
+  std::remove(sink.c_str());
+  return 0;
+}
+
+//--- formats ---//
+
+static int bench_formats(int argc, char* argv[])
+{
+  int products = argc > 2 ? atoi(argv[2]) : 1000000;
+  int repeats = argc > 3 ? atoi(argv[3]) : 5;
+
+  // a result shaped like a real one: 10 digit upc codes, names of a few words, 16
+  // warehouses and every stocked count from none to all of them
+  reports::shard_result result;
+  result.startDate = reports::make_date(2010, 5, 1);
+  result.actualStartDate = result.startDate;
+  result.daysSinceStart = 30;
+  for (int i = 0; i < 16; i++)
+    {
+      reports::shard_warehouse house = { true, i, 100 + i, {}, {} };
+      result.warehouses.insert(std::make_pair("Warehouse " + std::to_string(i), house));
+    }
+  for (int i = 0; i < products; i++)
+    {
+      char upc[16];
+      std::snprintf(upc, sizeof(upc), "%010d", i * 7);
+      reports::shard_food item;
+      item.name = "product number " + std::to_string(i) + " family size";
+      item.stocked = i % 17;
+      result.foods.insert(result.foods.end(), std::make_pair(std::string(upc), item));
+    }
+
+  const char* names[4] = { "text", "csv", "jsonl", "columnar" };
+  for (int f = 0; f < 4; f++)
+    {
+      reports::report_format format;
+      reports::parse_format(names[f], format);
+
+      double best = 1e300;
+      std::size_t bytes = 0;
+      for (int r = 0; r < repeats; r++)
+	{
+	  int fd = open("/dev/null", O_WRONLY);
+	  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	  {
+	    reports::report_writer out(fd, (std::size_t)1 << 40);
+	    reports::write_report(result, format, out);
+	    bytes = out.size();
+	  }
+	  best = std::min(best, elapsed(start));
+	  close(fd);
+	}
+      std::printf("%-10s %10.3f ms  %zu bytes\n", names[f], best, bytes);
+    }
+  return 0;
+}
+
+//--- transfer ---//
+
+// stock - fills every warehouse with a week of receives of every product
+static void stock(std::vector<reports::warehouse*>& houses, const std::vector<std::string>& upcs)
+{
+  for (int day = 0; day < 7; day++)
+    for (std::size_t h = 0; h < houses.size(); h++)
+      for (std::size_t p = 0; p < upcs.size(); p++)
+	houses[h]->receiveToShelf(upcs[p], 10 + (int)p % 7, day, 30);
+}
+
+static int bench_transfer(int argc, char* argv[])
+{
+  int products = argc > 2 ? atoi(argv[2]) : 100000;
+  int repeats = argc > 3 ? atoi(argv[3]) : 5;
+
+  std::vector<std::string> upcs;
+  for (int i = 0; i < products; i++)
+    {
+      char upc[16];
+      std::snprintf(upc, sizeof(upc), "%010d", i * 7);
+      upcs.push_back(upc);
+    }
+
+  // each pass moves a few lots' worth of every product around a ring of warehouses
+  const char* names[2] = { "transfer", "request+receive" };
+  for (int way = 0; way < 2; way++)
+    {
+      double best = 1e300;
+      long long moved = 0;
+      for (int r = 0; r < repeats; r++)
+	{
+	  std::vector<reports::warehouse*> houses;
+	  for (int h = 0; h < 8; h++)
+	    houses.push_back(new reports::warehouse());
+	  stock(houses, upcs);
+
+	  moved = 0;
+	  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	  for (int pass = 0; pass < 4; pass++)
+	    for (std::size_t h = 0; h < houses.size(); h++)
+	      {
+		reports::warehouse& from = *houses[h];
+		reports::warehouse& to = *houses[(h + 1 + pass) % houses.size()];
+		for (std::size_t p = 0; p < upcs.size(); p++)
+		  {
+		    int qty = 25 + (int)p % 11;
+		    if (way == 0)
+		      moved += from.transferToShelf(upcs[p], qty, to);
+		    else
+		      {
+			long long onHand = from.onHand(upcs[p]);
+			from.requestToShelf(upcs[p], qty);
+			int taken = (int)(onHand - from.onHand(upcs[p]));
+			to.receiveToShelf(upcs[p], taken, 7, 30);
+			moved += taken;
+		      }
+		  }
+	      }
+	  best = std::min(best, elapsed(start));
+
+	  for (std::size_t h = 0; h < houses.size(); h++)
+	    delete houses[h];
+	}
+      std::printf("%-16s %10.3f ms  %lld moved\n", names[way], best, moved);
+    }
+  return 0;
+}
+
+//--- counters ---//
+
+static int bench_counters(int argc, char* argv[])
+{
+  int products = argc > 2 ? atoi(argv[2]) : 20000;
+  int days = argc > 3 ? atoi(argv[3]) : 30;
+
+  std::vector<std::string> upcs;
+  for (int i = 0; i < products; i++)
+    {
+      char upc[16];
+      std::snprintf(upc, sizeof(upc), "%010d", i * 7);
+      upcs.push_back(upc);
+    }
+  std::vector<reports::warehouse*> houses;
+  for (int h = 0; h < 8; h++)
+    houses.push_back(new reports::warehouse());
+
+  // every day each warehouse receives every product, fills about two thirds of it back
+  // out, passes a little to its neighbour and expires what is past its shelf life
+  reports::perf_counters counters;
+  for (int day = 0; day < days; day++)
+    {
+      for (std::size_t h = 0; h < houses.size(); h++)
+	for (int p = 0; p < products; p++)
+	  {
+	    reports::perf_scope timed(&counters, reports::receive_region);
+	    houses[h]->receiveToShelf(upcs[p], 12 + p % 5, day, 3 + p % 9);
+	  }
+      for (std::size_t h = 0; h < houses.size(); h++)
+	for (int p = 0; p < products; p++)
+	  {
+	    reports::perf_scope timed(&counters, reports::request_region);
+	    houses[h]->requestToShelf(upcs[p], 8 + (p + day) % 7);
+	  }
+      for (std::size_t h = 0; h < houses.size(); h++)
+	for (int p = day % 4; p < products; p += 4)
+	  {
+	    reports::perf_scope timed(&counters, reports::transfer_region);
+	    houses[h]->transferToShelf(upcs[p], 3, *houses[(h + 1) % houses.size()]);
+	  }
+      for (std::size_t h = 0; h < houses.size(); h++)
+	{
+	  reports::perf_scope timed(&counters, reports::advance_region);
+	  houses[h]->advanceDay(day);
+	}
+    }
+  counters.print(std::cout);
+
+  for (std::size_t h = 0; h < houses.size(); h++)
+    delete houses[h];
+  return 0;
+}
+
+//--- horizon ---//
+
+static int bench_horizon(int argc, char* argv[])
+{
+  int days = argc > 2 ? atoi(argv[2]) : 2000;
+  int daily = argc > 3 ? atoi(argv[3]) : 5000;
+  bool keep = argc > 4 && std::string(argv[4]) == "keep";
+  int report = days / 10 > 0 ? days / 10 : 1;
+
+  // each day a window of products moves on by a fifth, so every product is received on
+  // five days in a row and then never again
+  std::vector<reports::warehouse*> houses;
+  for (int h = 0; h < 4; h++)
+    {
+      houses.push_back(new reports::warehouse());
+      if (keep)
+	houses.back()->keepEmptyShelves();
+    }
+
+  std::printf("%8s %14s %10s %8s %8s %10s %10s %10s %12s\n", "day", "advanceDay ms", "live", "dead",
+	      "spare", "created", "reused", "reclaimed", "upcs so far");
+  double advanceTime = 0;
+  for (int day = 0; day < days; day++)
+    {
+      int first = day * (daily / 5);
+      for (std::size_t h = 0; h < houses.size(); h++)
+	for (int p = first; p < first + daily; p++)
+	  {
+	    char upc[16];
+	    std::snprintf(upc, sizeof(upc), "%010d", p);
+	    houses[h]->receiveToShelf(upc, 6, day, 1 + p % 5);
+	    if (p % 3 == 0)
+	      houses[h]->requestToShelf(upc, 9);
+	  }
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (std::size_t h = 0; h < houses.size(); h++)
+	houses[h]->advanceDay(day);
+      advanceTime += elapsed(start);
+
+      if ((day + 1) % report == 0)
+	{
+	  reports::shelf_stats total = { 0, 0, 0, 0, 0, 0 };
+	  for (std::size_t h = 0; h < houses.size(); h++)
+	    {
+	      reports::shelf_stats one = houses[h]->shelfStats();
+	      total.live += one.live;
+	      total.dead += one.dead;
+	      total.spare += one.spare;
+	      total.created += one.created;
+	      total.reused += one.reused;
+	      total.reclaimed += one.reclaimed;
+	    }
+	  std::printf("%8d %14.3f %10lld %8lld %8lld %10lld %10lld %10lld %12d\n", day + 1, advanceTime / report,
+		      total.live, total.dead, total.spare, total.created, total.reused, total.reclaimed,
+		      first + daily);
+	  advanceTime = 0;
+	}
+    }
+
+  for (std::size_t h = 0; h < houses.size(); h++)
+    delete houses[h];
+  return 0;
+}
+
+//--- drain ---//
+
+// fill - receives one unit of the product on each of lots days, a lot a day
+static void fill(reports::warehouse& house, const char* upc, int lots)
+{
+  for (int day = 0; day < lots; day++)
+    house.receiveToShelf(upc, 1, day, lots + 1);
+}
+
+static int bench_drain(int argc, char* argv[])
+{
+  int most = argc > 2 ? atoi(argv[2]) : 1 << 20;
+  int repeats = argc > 3 ? atoi(argv[3]) : 3;
+  const int limit = (int)reports::node::spare_limit;
+
+  std::printf("%10s %16s %16s\n", "lots", "with room us", "list full us");
+  for (int lots = 1024; lots <= most; lots *= 4)
+    {
+      double best[2] = { 1e300, 1e300 };
+      for (int run = 0; run < repeats; run++)
+	for (int full = 0; full < 2; full++)
+	  {
+	    // a second product of spare_limit lots takes every spare node left over from the
+	    // last run; draining it first fills the list
+	    reports::warehouse house;
+	    fill(house, "0000000001", lots);
+	    fill(house, "0000000002", limit);
+	    if (full)
+	      house.requestToShelf("0000000002", limit);
+
+	    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	    house.requestToShelf("0000000001", lots);
+	    double time = elapsed(start) * 1000;
+	    if (time < best[full])
+	      best[full] = time;
+	  }
+      std::printf("%10d %16.1f %16.1f\n", lots, best[0], best[1]);
+    }
+  return 0;
+}
+
+//--- sketch ---//
+
+static int bench_sketch(int argc, char* argv[])
+{
+  int updates = argc > 2 ? atoi(argv[2]) : 2000000;
+  int products = argc > 3 ? atoi(argv[3]) : 200000;
+
+  // a skewed stream: product p is picked about as often as 1 / (p + 1)
+  std::vector<std::string> upcs;
+  for (int i = 0; i < products; i++)
+    {
+      char upc[16];
+      std::snprintf(upc, sizeof(upc), "%010d", i * 7);
+      upcs.push_back(upc);
+    }
+  std::vector<int> stream;
+  std::vector<int> quantities;
+  unsigned int seed = 12345;
+  for (int i = 0; i < updates; i++)
+    {
+      seed = seed * 1103515245u + 12345u;
+      double u = (double)(seed >> 8) / (double)(1u << 24);
+      stream.push_back((int)std::pow((double)products + 1, u) - 1);
+      quantities.push_back(1 + (int)(seed % 9));
+    }
+
+  // the codes laid out in stream order, as a log's lines would be
+  std::string text;
+  for (int i = 0; i < updates; i++)
+    text += upcs[stream[i]];
+
+  reports::sketch_config config;
+  reports::heavy_hitters sketch(config);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < updates; i++)
+    sketch.add(std::string_view(text.data() + i * 10, 10), quantities[i]);
+  double addTime = elapsed(start);
+
+  // exact totals, to check the top list against
+  std::vector<long long> exact(products, 0);
+  for (int i = 0; i < updates; i++)
+    exact[stream[i]] += quantities[i];
+  std::vector<int> order(products);
+  for (int i = 0; i < products; i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&exact](int a, int b) { return exact[a] > exact[b]; });
+
+  std::vector<std::pair<std::string, long long> > top;
+  sketch.top(top);
+  int found = 0;
+  long long worst = 0;
+  for (std::size_t i = 0; i < top.size(); i++)
+    {
+      int p = atoi(top[i].first.c_str()) / 7;
+      worst = std::max(worst, top[i].second - exact[p]);
+      for (int j = 0; j < config.k; j++)
+	if (order[j] == p)
+	  found++;
+    }
+  std::printf("heavy_hitters::add %8.2f ns per update, %zu bytes, true top %d found %d, worst overestimate %lld (bound %.0f)\n",
+	      addTime * 1e6 / updates, sketch.bytes(), config.k, found, worst, config.epsilon * sketch.total());
+
+  // the same stream as requests, without and with the sketches, alternating and keeping
+  // the best of three of each since the difference is small next to the run to run noise
+  double best[2] = { 0, 0 };
+  for (int run = 0; run < 6; run++)
+    {
+      int tracked = run % 2;
+      reports::warehouse house;
+      if (tracked)
+	house.trackHeavyHitters(config);
+      for (int p = 0; p < products; p++)
+	house.receiveToShelf(upcs[p], 1 << 20, 0, 1000);
+
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < updates; i++)
+	house.requestToShelf(upcs[stream[i]], quantities[i]);
+      double time = elapsed(start) * 1e6 / updates;
+      if (run < 2 || time < best[tracked])
+	best[tracked] = time;
+    }
+  std::printf("requestToShelf without       %8.2f ns per request (best of 3)\n", best[0]);
+  std::printf("requestToShelf with sketches %8.2f ns per request (best of 3)\n", best[1]);
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string name = argc > 1 ? argv[1] : "";
+  if (name == "io")
+    return bench_io(argc, argv);
+  if (name == "compressed")
+    return bench_compressed(argc, argv);
+  if (name == "formats")
+    return bench_formats(argc, argv);
+  if (name == "transfer")
+    return bench_transfer(argc, argv);
+  if (name == "counters")
+    return bench_counters(argc, argv);
+  if (name == "horizon")
+    return bench_horizon(argc, argv);
+  if (name == "drain")
+    return bench_drain(argc, argv);
+  if (name == "sketch")
+    return bench_sketch(argc, argv);
+
+  std::cout << "usage: benchmark io <log file> [repeats]" << std::endl;
+  std::cout << "       benchmark compressed <log file> <compressed copy>... [repeats]" << std::endl;
+  std::cout << "       benchmark formats [products] [repeats]" << std::endl;
+  std::cout << "       benchmark transfer [products] [repeats]" << std::endl;
+  std::cout << "       benchmark counters [products] [days]" << std::endl;
+  std::cout << "       benchmark horizon [days] [products a day] [keep]" << std::endl;
+  std::cout << "       benchmark drain [lots] [repeats]" << std::endl;
+  std::cout << "       benchmark sketch [updates] [products]" << std::endl;
+  return 1;
+}
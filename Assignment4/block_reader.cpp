@@ -0,0 +1,712 @@
+//----------------------------------------------
+// block_reader.cpp
+//
+// class function definitions for block_reader
+// a more detailed description can be found in block_reader.h
+// also contains the two background read implementations: one built directly on the
+// io_uring system calls, and a fallback which runs pread on a helper thread, plus the
+// gzip and zstd decoders the helper thread runs for compressed files
+//----------------------------------------------
+
+#include "block_reader.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#ifdef REPORTS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef REPORTS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace reports
+{
+  // read_fully - preads until size bytes are read or the end of the file is reached
+  // returns - bytes read, or -1 on error
+  static long read_fully(int fd, char* buffer, std::size_t size, long long offset)
+  {
+    std::size_t done = 0;
+    while (done < size)
+      {
+	ssize_t n = pread(fd, buffer + done, size - done, offset + done);
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n < 0)
+	  return -1;
+	if (n == 0)
+	  break;
+	done += n;
+      }
+    return (long)done;
+  }
+
+  // read_some - reads whatever is available at the current file position
+  // returns - bytes read, 0 at the end of the file, or -1 on error
+  static long read_some(int fd, char* buffer, std::size_t size)
+  {
+    while (true)
+      {
+	ssize_t n = read(fd, buffer, size);
+	if (n < 0 && errno == EINTR)
+	  continue;
+	return (long)n;
+      }
+  }
+
+  // block_source - reads one block at a time in the background
+  // start begins a read, wait blocks until it completes and returns its byte count
+  // (-1 on error, described by failure)
+  class block_source
+  {
+  public:
+    virtual ~block_source() {}
+    virtual void start(char* buffer, std::size_t size, long long offset) = 0;
+    virtual long wait() = 0;
+    virtual bool is_uring() const = 0;
+    virtual const char* compression() const { return "none"; }
+    virtual std::string failure() const { return "read error"; }
+  };
+
+  //--- decompression ---//
+
+  // decoder - turns the compressed file into the bytes of the log, sequentially
+  // fill decompresses up to size bytes into buffer
+  // returns - bytes produced, 0 at the end of the data, -1 on error (see message)
+  class decoder
+  {
+  public:
+    decoder(int i_fd) : fd(i_fd), input(1 << 18), inputDone(false)
+    {
+    }
+    virtual ~decoder() {}
+    virtual long fill(char* buffer, std::size_t size) = 0;
+    virtual const char* name() const = 0;
+
+    std::string message;
+
+  protected:
+    // refill - reads the next chunk of compressed input
+    // returns - bytes read, 0 (and inputDone set) at the end of the file, -1 on error
+    long refill()
+    {
+      long n = read_some(fd, &input[0], input.size());
+      if (n == 0)
+	inputDone = true;
+      if (n < 0)
+	message = "read error";
+      return n;
+    }
+
+    // failed - records the error and returns -1 for fill
+    long failed(const std::string& what)
+    {
+      message = std::string(name()) + ": " + what;
+      return -1;
+    }
+
+    int fd;
+    std::vector<char> input;
+    bool inputDone;
+  };
+
+#ifdef REPORTS_ZLIB
+  // gzip_decoder - inflate with gzip header detection; a file of several gzip members
+  // (as written by concatenating .gz files or by pigz) is decoded member after member
+  class gzip_decoder : public decoder
+  {
+  public:
+    gzip_decoder(int i_fd) : decoder(i_fd), inMember(false)
+    {
+      std::memset(&stream, 0, sizeof(stream));
+      ready = inflateInit2(&stream, 15 + 16) == Z_OK;
+    }
+
+    ~gzip_decoder()
+    {
+      if (ready)
+	inflateEnd(&stream);
+    }
+
+    long fill(char* buffer, std::size_t size)
+    {
+      if (!ready)
+	return failed("cannot initialise zlib");
+
+      stream.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream.avail_out = (uInt)size;
+      while (stream.avail_out > 0)
+	{
+	  if (stream.avail_in == 0 && !inputDone)
+	    {
+	      long n = refill();
+	      if (n < 0)
+		return -1;
+	      stream.next_in = reinterpret_cast<Bytef*>(&input[0]);
+	      stream.avail_in = (uInt)n;
+	    }
+	  // the input ended between two members
+	  if (inputDone && stream.avail_in == 0 && !inMember)
+	    break;
+
+	  uInt before = stream.avail_out;
+	  int status = inflate(&stream, Z_NO_FLUSH);
+	  if (status == Z_STREAM_END)
+	    {
+	      inflateReset(&stream);
+	      inMember = false;
+	      continue;
+	    }
+	  if (status != Z_OK && status != Z_BUF_ERROR)
+	    return failed(stream.msg != NULL ? stream.msg : "corrupt input");
+	  inMember = true;
+	  if (inputDone && stream.avail_in == 0 && stream.avail_out == before)
+	    return failed("truncated input");
+	}
+      return (long)(size - stream.avail_out);
+    }
+
+    const char* name() const
+    {
+      return "gzip";
+    }
+
+  private:
+    z_stream stream;
+    bool ready;
+
+    // true while a member has been started but not finished
+    bool inMember;
+  };
+#endif
+
+#ifdef REPORTS_ZSTD
+  // zstd_decoder - streaming decompression; consecutive frames (as written by zstd -T or
+  // by concatenating .zst files) are decoded one after the other
+  class zstd_decoder : public decoder
+  {
+  public:
+    zstd_decoder(int i_fd) : decoder(i_fd), context(ZSTD_createDCtx()), lastResult(0)
+    {
+      in.src = &input[0];
+      in.size = 0;
+      in.pos = 0;
+    }
+
+    ~zstd_decoder()
+    {
+      ZSTD_freeDCtx(context);
+    }
+
+    long fill(char* buffer, std::size_t size)
+    {
+      if (context == NULL)
+	return failed("cannot create a decompression context");
+
+      ZSTD_outBuffer out = { buffer, size, 0 };
+      while (out.pos < out.size)
+	{
+	  if (in.pos == in.size && !inputDone)
+	    {
+	      long n = refill();
+	      if (n < 0)
+		return -1;
+	      in.size = n;
+	      in.pos = 0;
+	    }
+
+	  // with the input used up only an unfinished frame can still produce output
+	  bool drained = inputDone && in.pos == in.size;
+	  if (drained && lastResult == 0)
+	    break;
+
+	  std::size_t before = out.pos;
+	  std::size_t result = ZSTD_decompressStream(context, &out, &in);
+	  if (ZSTD_isError(result))
+	    return failed(ZSTD_getErrorName(result));
+	  lastResult = result;
+	  if (drained && out.pos == before)
+	    return failed("truncated input");
+	}
+      return (long)out.pos;
+    }
+
+    const char* name() const
+    {
+      return "zstd";
+    }
+
+  private:
+    ZSTD_DCtx* context;
+    ZSTD_inBuffer in;
+
+    // the last ZSTD_decompressStream result, 0 once a frame is complete
+    std::size_t lastResult;
+  };
+#endif
+
+  // unsupported_decoder - a compressed file this build has no library for
+  class unsupported_decoder : public decoder
+  {
+  public:
+    unsupported_decoder(int i_fd, const char* i_name, const char* i_flags)
+      : decoder(i_fd), format(i_name), flags(i_flags)
+    {
+    }
+
+    long fill(char*, std::size_t)
+    {
+      return failed(std::string("compressed input needs a build with ") + flags);
+    }
+
+    const char* name() const
+    {
+      return format;
+    }
+
+  private:
+    const char* format;
+    const char* flags;
+  };
+
+  // open_decoder - picks a decoder from the first bytes of the file
+  // returns - NULL if the file is not compressed
+  static decoder* open_decoder(int fd)
+  {
+    unsigned char magic[4];
+    if (read_fully(fd, reinterpret_cast<char*>(magic), sizeof(magic), 0) < 2)
+      return NULL;
+
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+      {
+#ifdef REPORTS_ZLIB
+	return new gzip_decoder(fd);
+#else
+	return new unsupported_decoder(fd, "gzip", "-DREPORTS_ZLIB -lz");
+#endif
+      }
+    if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+      {
+#ifdef REPORTS_ZSTD
+	return new zstd_decoder(fd);
+#else
+	return new unsupported_decoder(fd, "zstd", "-DREPORTS_ZSTD -lzstd");
+#endif
+      }
+    return NULL;
+  }
+
+  //--- io_uring ---//
+
+  // uring_source - submits one IORING_OP_READ at a time on a two entry ring
+  // glibc has no wrappers for the io_uring calls, so they are made through syscall
+  class uring_source : public block_source
+  {
+  public:
+    // open - sets up a ring for the file
+    // returns - the new source, or NULL if io_uring is unavailable (old kernel, seccomp)
+    static uring_source* open(int fd)
+    {
+#ifdef __NR_io_uring_setup
+      uring_source* source = new uring_source(fd);
+      if (source->setup())
+	return source;
+      delete source;
+#endif
+      return NULL;
+    }
+
+    ~uring_source()
+    {
+      if (sqRing != MAP_FAILED)
+	munmap(sqRing, sqRingSize);
+      if (cqRing != MAP_FAILED)
+	munmap(cqRing, cqRingSize);
+      if (sqes != MAP_FAILED)
+	munmap(sqes, sqesSize);
+      if (ring >= 0)
+	close(ring);
+    }
+
+    void start(char* i_buffer, std::size_t i_size, long long i_offset)
+    {
+      buffer = i_buffer;
+      size = i_size;
+      offset = i_offset;
+
+      // fill in the next submission queue entry
+      unsigned tail = *sqTail;
+      unsigned index = tail & *sqMask;
+      io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = (unsigned long long)buffer;
+      sqe->len = (unsigned)size;
+      sqe->off = offset;
+      sqArray[index] = index;
+
+      // publish it to the kernel and submit
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      submitted = enter(1, 0, 0) >= 0;
+    }
+
+    long wait()
+    {
+      // if the submission itself failed, read synchronously instead
+      if (!submitted)
+	return read_fully(fd, buffer, size, offset);
+
+      while (true)
+	{
+	  unsigned head = *cqHead;
+	  if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+	    {
+	      long result = (static_cast<io_uring_cqe*>(cqes) + (head & *cqMask))->res;
+	      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+	      // kernels before 5.6 accept the ring but not IORING_OP_READ
+	      if (result == -EINVAL || result == -EOPNOTSUPP)
+		return read_fully(fd, buffer, size, offset);
+	      if (result < 0)
+		return -1;
+
+	      // a short read before the end of the file, finish it off synchronously
+	      if (result > 0 && (std::size_t)result < size)
+		{
+		  long rest = read_fully(fd, buffer + result, size - result, offset + result);
+		  if (rest > 0)
+		    result += rest;
+		}
+	      return result;
+	    }
+
+	  if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+	    return read_fully(fd, buffer, size, offset);
+	}
+    }
+
+    bool is_uring() const
+    {
+      return true;
+    }
+
+  private:
+    uring_source(int i_fd)
+      : fd(i_fd), ring(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(MAP_FAILED),
+	buffer(NULL), size(0), offset(0), submitted(false)
+    {
+    }
+
+    // setup - creates the ring and maps its queues into memory
+    bool setup()
+    {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+      ring = (int)syscall(__NR_io_uring_setup, 2, &params);
+      if (ring < 0)
+	return false;
+
+      sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+      sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+      cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+      sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+      if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+	return false;
+
+      char* sq = static_cast<char*>(sqRing);
+      char* cq = static_cast<char*>(cqRing);
+      sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes = cq + params.cq_off.cqes;
+      return true;
+    }
+
+    // enter - wrapper for the io_uring_enter system call
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+      return (int)syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, NULL, 0);
+    }
+
+    int fd;
+    int ring;
+
+    // mapped queues and their sizes
+    void* sqRing;
+    void* cqRing;
+    void* sqes;
+    std::size_t sqRingSize;
+    std::size_t cqRingSize;
+    std::size_t sqesSize;
+
+    // pointers into the mapped queues
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    void* cqes;
+
+    // the read in flight
+    char* buffer;
+    std::size_t size;
+    long long offset;
+    bool submitted;
+  };
+
+  //--- pread thread ---//
+
+  // thread_source - a helper thread which waits for a block request and preads it
+  // given a decoder, the thread decompresses the next block instead (offsets are ignored,
+  // blocks are always asked for in order); the source owns the decoder
+  class thread_source : public block_source
+  {
+  public:
+    thread_source(int i_fd, decoder* i_codec = NULL)
+      : fd(i_fd), codec(i_codec), buffer(NULL), size(0), offset(0), pending(false), done(false),
+	stopping(false), result(0)
+    {
+      worker = std::thread(&thread_source::run, this);
+    }
+
+    ~thread_source()
+    {
+      {
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = true;
+      }
+      wake.notify_all();
+      worker.join();
+      delete codec;
+    }
+
+    void start(char* i_buffer, std::size_t i_size, long long i_offset)
+    {
+      {
+	std::lock_guard<std::mutex> guard(lock);
+	buffer = i_buffer;
+	size = i_size;
+	offset = i_offset;
+	pending = true;
+	done = false;
+      }
+      wake.notify_all();
+    }
+
+    long wait()
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this] { return done; });
+      done = false;
+      return result;
+    }
+
+    bool is_uring() const
+    {
+      return false;
+    }
+
+    const char* compression() const
+    {
+      return codec != NULL ? codec->name() : "none";
+    }
+
+    // failure - only called after wait, so the helper thread is idle
+    std::string failure() const
+    {
+      return codec != NULL ? codec->message : "read error";
+    }
+
+  private:
+    // run - body of the helper thread
+    void run()
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      while (true)
+	{
+	  wake.wait(guard, [this] { return pending || stopping; });
+	  if (!pending)
+	    return;
+
+	  pending = false;
+	  guard.unlock();
+	  long bytes = codec != NULL ? codec->fill(buffer, size) : read_fully(fd, buffer, size, offset);
+	  guard.lock();
+
+	  result = bytes;
+	  done = true;
+	  wake.notify_all();
+	}
+    }
+
+    int fd;
+    decoder* codec;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+
+    // the request and its result, guarded by lock
+    char* buffer;
+    std::size_t size;
+    long long offset;
+    bool pending;
+    bool done;
+    bool stopping;
+    long result;
+  };
+
+  //--- block_reader ---//
+
+  // constructor - opens the file, picks a background reader and requests the first block
+  block_reader::block_reader(const std::string& fileName, std::size_t blockSize, bool allowUring)
+    : fd(-1), source(NULL), current(1), position(0), length(0), nextOffset(0),
+      finished(true), carryOut(false)
+  {
+    fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    // sequential hint lets the kernel read ahead of the blocks
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    blocks[0].resize(blockSize);
+    blocks[1].resize(blockSize);
+
+    // compressed files always go through the helper thread, which runs the decoder
+    decoder* codec = open_decoder(fd);
+    if (codec != NULL)
+      source = new thread_source(fd, codec);
+    if (source == NULL && allowUring)
+      source = uring_source::open(fd);
+    if (source == NULL)
+      source = new thread_source(fd);
+
+    // the first block goes into block 0, which becomes current on the first swap
+    source->start(&blocks[0][0], blockSize, 0);
+    nextOffset = blockSize;
+    finished = false;
+  }
+
+  // destructor - a read may still be in flight into one of the blocks, so wait for it
+  // before the blocks are freed
+  block_reader::~block_reader()
+  {
+    if (source != NULL && !finished)
+      source->wait();
+    delete source;
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool block_reader::is_open() const
+  {
+    return fd >= 0;
+  }
+
+  bool block_reader::uses_io_uring() const
+  {
+    return source != NULL && source->is_uring();
+  }
+
+  const char* block_reader::compression() const
+  {
+    return source != NULL ? source->compression() : "none";
+  }
+
+  // getline - scans the current block for the next '\n'
+  // a line which runs off the end of the block is collected in carry and completed from
+  // the next block
+  bool block_reader::getline(std::string_view& line)
+  {
+    // the carried line handed out last time is no longer needed
+    if (carryOut)
+      {
+	carry.clear();
+	carryOut = false;
+      }
+
+    while (true)
+      {
+	if (position < length)
+	  {
+	    const char* begin = &blocks[current][position];
+	    const char* newline = static_cast<const char*>(std::memchr(begin, '\n', length - position));
+	    if (newline != NULL)
+	      {
+		std::size_t size = newline - begin;
+		position += size + 1;
+
+		// the whole line lies in this block, hand out a view of it directly
+		if (carry.empty())
+		  {
+		    line = std::string_view(begin, size);
+		    return true;
+		  }
+
+		carry.append(begin, size);
+		line = carry;
+		carryOut = true;
+		return true;
+	      }
+
+	    // no newline before the end of the block
+	    carry.append(begin, length - position);
+	    position = length;
+	  }
+
+	if (finished || !swapBlocks())
+	  {
+	    // like std::getline, a last line without a newline is still returned
+	    if (!carry.empty())
+	      {
+		line = carry;
+		carryOut = true;
+		return true;
+	      }
+	    return false;
+	  }
+      }
+  }
+
+  // swapBlocks - waits for the block in flight and starts reading the next one
+  bool block_reader::swapBlocks()
+  {
+    long bytes = source->wait();
+    current = 1 - current;
+    position = 0;
+
+    if (bytes <= 0)
+      {
+	length = 0;
+	finished = true;
+	if (bytes < 0)
+	  throw std::runtime_error(source->failure());
+	return false;
+      }
+    length = bytes;
+
+    // the other block has been fully consumed, so it can be refilled now
+    std::vector<char>& next = blocks[1 - current];
+    source->start(&next[0], next.size(), nextOffset);
+    nextOffset += next.size();
+    return true;
+  }
+}
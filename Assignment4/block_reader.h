@@ -0,0 +1,97 @@
+//--------------------------------------------
+// block_reader.h
+//
+// header for the block_reader class
+// a block_reader reads a file in large blocks and hands it back out one line at a time
+// it keeps two blocks: while the lines of one block are being parsed the next block is
+// already being read in the background, so parsing and disk reads overlap
+//
+// the background read is done with io_uring when the kernel (and container) allows it,
+// otherwise a helper thread issues pread calls
+//
+// gzip and zstd files are recognised by their magic bytes and decompressed on the helper
+// thread straight into the blocks, so decompressing the next block overlaps with parsing
+// the current one and no decompressed copy is written to disk
+// gzip needs a build with -DREPORTS_ZLIB -lz and zstd one with -DREPORTS_ZSTD -lzstd;
+// without them a compressed file is still recognised, and reading it throws
+//--------------------------------------------
+
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace reports
+{
+  // forward declaration of the background read implementation, see block_reader.cpp
+  class block_source;
+
+  class block_reader
+  {
+  public:
+    // constructor - opens the file and starts reading the first block
+    // parameter - fileName - path of the file to read
+    // parameter - blockSize - size of each of the two blocks in bytes
+    // parameter - allowUring - false forces the pread thread even where io_uring works
+    block_reader(const std::string& fileName, std::size_t blockSize = 1 << 20, bool allowUring = true);
+
+    // destructor - waits for any outstanding read and closes the file
+    ~block_reader();
+
+    // is_open - returns true if the file could be opened
+    bool is_open() const;
+
+    // getline - fetches the next line without its '\n', like std::getline
+    // the returned view stays valid until the next call
+    // returns - false once the end of the file is reached
+    // throws - std::runtime_error if the file cannot be read or decompressed
+    bool getline(std::string_view& line);
+
+    // uses_io_uring - returns true if blocks are read with io_uring rather than a thread
+    bool uses_io_uring() const;
+
+    // compression - returns "gzip" or "zstd" for a compressed file, otherwise "none"
+    const char* compression() const;
+
+  private:
+    // no copying, the reader owns a file descriptor and possibly a thread
+    block_reader(const block_reader&);
+    block_reader& operator=(const block_reader&);
+
+    // swapBlocks - waits for the block in flight, makes it current and starts reading
+    // the one after it into the block just finished with
+    // returns - false if the block read was empty (end of file)
+    bool swapBlocks();
+
+    // file descriptor of the open file, -1 if it could not be opened
+    int fd;
+
+    // background reader for the file
+    block_source* source;
+
+    // the two blocks, current is the one being split into lines
+    std::vector<char> blocks[2];
+    int current;
+
+    // read position and valid length of the current block
+    std::size_t position;
+    std::size_t length;
+
+    // file offset of the next block to request
+    long long nextOffset;
+
+    // true once a read returns no more data
+    bool finished;
+
+    // holds a line which straddles two blocks
+    std::string carry;
+
+    // true if the last line handed out was carry, so it must be cleared next call
+    bool carryOut;
+  };
+}
+
+#endif
@@ -0,0 +1,208 @@
+//----------------------------------------------
+// catalog.cpp
+//
+// class function definitions for food_catalog
+// a more detailed description can be found in catalog.h
+//----------------------------------------------
+
+#include "catalog.h"
+
+#include <algorithm>
+
+namespace reports
+{
+  food_catalog::food_catalog()
+    : frozen(false)
+  {
+  }
+
+  // add - products declared after the freeze go to the overlay
+  void food_catalog::add(std::string_view upc, int shelfLife, std::string_view name)
+  {
+    if (frozen && find(upc) >= 0)
+      return;
+    if (pendingIndex.find(upc) != pendingIndex.end())
+      return;
+
+    entry added;
+    added.upcOffset = (std::uint32_t)pendingArena.size();
+    added.upcLength = (std::uint32_t)upc.size();
+    pendingArena.append(upc);
+    added.nameOffset = (std::uint32_t)pendingArena.size();
+    added.nameLength = (std::uint32_t)name.size();
+    pendingArena.append(name);
+    added.shelfLife = shelfLife;
+
+    pendingIndex.insert(std::make_pair(std::string(upc), (int)pending.size()));
+    pending.push_back(added);
+  }
+
+  // freeze - copies the pending products into a fresh arena in UPC order and hashes them
+  void food_catalog::freeze()
+  {
+    if (frozen)
+      return;
+    frozen = true;
+
+    std::shared_ptr<table> built = std::make_shared<table>();
+    built->arena.reserve(pendingArena.size());
+    built->entries.reserve(pending.size());
+
+    // pendingIndex is ordered by UPC code, so ids come out in UPC order
+    typedef std::map<std::string, int, std::less<> >::const_iterator walkThrough;
+    for (walkThrough iterator = pendingIndex.begin(); iterator != pendingIndex.end(); ++iterator)
+      {
+	const entry& from = pending[iterator->second];
+	entry to = from;
+	to.upcOffset = (std::uint32_t)built->arena.size();
+	built->arena.append(pendingArena, from.upcOffset, from.upcLength);
+	to.nameOffset = (std::uint32_t)built->arena.size();
+	built->arena.append(pendingArena, from.nameOffset, from.nameLength);
+	built->entries.push_back(to);
+      }
+
+    // open addressed table at most half full
+    std::size_t capacity = 16;
+    built->shift = 60;
+    while (capacity < built->entries.size() * 2)
+      {
+	capacity *= 2;
+	built->shift--;
+      }
+    built->keys.assign(capacity, 0);
+    built->ids.assign(capacity, 0);
+    built->mask = capacity - 1;
+    frozenTable = built;
+
+    for (std::size_t id = 0; id < built->entries.size(); id++)
+      {
+	std::string_view code(built->arena.data() + built->entries[id].upcOffset, built->entries[id].upcLength);
+	std::uint64_t key;
+	if (!pack(code, key))
+	  {
+	    built->unpacked.insert(std::make_pair(std::string(code), (int)id));
+	    continue;
+	  }
+
+	std::size_t at = slot(key);
+	while (built->ids[at] != 0)
+	  at = (at + 1) & built->mask;
+	built->keys[at] = key;
+	built->ids[at] = (int)id + 1;
+      }
+
+    pendingArena.clear();
+    pending.clear();
+    pendingIndex.clear();
+  }
+
+  // find - the hash table first, then the overlay
+  int food_catalog::find(std::string_view upc)
+  {
+    if (!frozen)
+      freeze();
+
+    const table& frozenPart = *frozenTable;
+    std::uint64_t key;
+    if (pack(upc, key))
+      {
+	for (std::size_t at = slot(key); frozenPart.ids[at] != 0; at = (at + 1) & frozenPart.mask)
+	  if (frozenPart.keys[at] == key)
+	    return frozenPart.ids[at] - 1;
+      }
+    else
+      {
+	std::map<std::string, int, std::less<> >::const_iterator found = frozenPart.unpacked.find(upc);
+	if (found != frozenPart.unpacked.end())
+	  return found->second;
+      }
+
+    if (!pendingIndex.empty())
+      {
+	std::map<std::string, int, std::less<> >::const_iterator found = pendingIndex.find(upc);
+	if (found != pendingIndex.end())
+	  return (int)frozenPart.entries.size() + found->second;
+      }
+    return -1;
+  }
+
+  int food_catalog::size() const
+  {
+    return (frozen ? (int)frozenTable->entries.size() : 0) + (int)pending.size();
+  }
+
+  int food_catalog::shelfLife(int id) const
+  {
+    const std::string* arena;
+    return entryOf(id, arena).shelfLife;
+  }
+
+  std::string_view food_catalog::name(int id) const
+  {
+    const std::string* arena;
+    const entry& found = entryOf(id, arena);
+    return std::string_view(arena->data() + found.nameOffset, found.nameLength);
+  }
+
+  std::string_view food_catalog::upc(int id) const
+  {
+    const std::string* arena;
+    const entry& found = entryOf(id, arena);
+    return std::string_view(arena->data() + found.upcOffset, found.upcLength);
+  }
+
+  // sorted - merges the frozen ids (already in order) with the overlay's
+  std::vector<int> food_catalog::sorted() const
+  {
+    int base = frozen ? (int)frozenTable->entries.size() : 0;
+    std::vector<int> result;
+    result.reserve(size());
+
+    int next = 0;
+    typedef std::map<std::string, int, std::less<> >::const_iterator walkThrough;
+    for (walkThrough iterator = pendingIndex.begin(); iterator != pendingIndex.end(); ++iterator)
+      {
+	while (next < base && upc(next) < iterator->first)
+	  result.push_back(next++);
+	result.push_back(base + iterator->second);
+      }
+    while (next < base)
+      result.push_back(next++);
+    return result;
+  }
+
+  // pack - up to 15 digits fit below 2^60, the length goes in the top 4 bits
+  bool food_catalog::pack(std::string_view upc, std::uint64_t& key)
+  {
+    if (upc.empty() || upc.size() > 15)
+      return false;
+
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < upc.size(); i++)
+      {
+	if (upc[i] < '0' || upc[i] > '9')
+	  return false;
+	value = value * 10 + (std::uint64_t)(upc[i] - '0');
+      }
+    key = ((std::uint64_t)upc.size() << 60) | value;
+    return true;
+  }
+
+  // slot - multiplicative (Fibonacci) hashing of the packed code
+  std::size_t food_catalog::slot(std::uint64_t key) const
+  {
+    return (std::size_t)((key * 0x9E3779B97F4A7C15ull) >> frozenTable->shift) & frozenTable->mask;
+  }
+
+  const food_catalog::entry& food_catalog::entryOf(int id, const std::string*& arena) const
+  {
+    int base = frozen ? (int)frozenTable->entries.size() : 0;
+    if (id < base)
+      {
+	arena = &frozenTable->arena;
+	return frozenTable->entries[id];
+      }
+    arena = &pendingArena;
+    return pending[id - base];
+  }
+}
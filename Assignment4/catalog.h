@@ -0,0 +1,108 @@
+//--------------------------------------------
+// catalog.h
+//
+// header for the food_catalog class
+// the catalog holds every product declared by a FoodItem line: its UPC code, shelf life
+// and name
+//
+// while the FoodItem lines are being read products are only collected; the first lookup
+// freezes the catalog into an immutable table:
+// - products are numbered (ids) in UPC order
+// - shelf lives are a dense array indexed by id
+// - all UPC codes and names live in one string arena, indexed by offsets
+// - all-digit UPC codes are packed into an integer and found through an open addressed
+//   hash table built once at freeze time
+// lookups return ids and views into the arena, nothing is copied
+// FoodItem lines appearing after the freeze go to a small mutable overlay which is
+// searched after the table
+// copies of a catalog share the frozen table
+//--------------------------------------------
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace reports
+{
+  class food_catalog
+  {
+  public:
+    food_catalog();
+
+    // add - declares a product; like std::map::insert, a UPC code already in the catalog
+    // keeps its first declaration
+    void add(std::string_view upc, int shelfLife, std::string_view name);
+
+    // freeze - builds the immutable table from the products added so far
+    // called automatically by the first find
+    void freeze();
+
+    // find - returns the id of the product, or -1 if it was never declared
+    int find(std::string_view upc);
+
+    // size - returns the number of products; ids run from 0 to size() - 1
+    int size() const;
+
+    // accessors by id
+    int shelfLife(int id) const;
+    std::string_view name(int id) const;
+    std::string_view upc(int id) const;
+
+    // sorted - returns every id in UPC order
+    std::vector<int> sorted() const;
+
+  private:
+    // pack - turns an all-digit UPC code into a hash key (its value tagged with its
+    // length, so "0012" and "12" differ)
+    // returns - false if the code has non digits or is too long to pack
+    static bool pack(std::string_view upc, std::uint64_t& key);
+
+    // slot - first hash table slot to probe for key
+    std::size_t slot(std::uint64_t key) const;
+
+    // entry - a product in the arena
+    struct entry
+    {
+      std::uint32_t upcOffset;
+      std::uint32_t nameOffset;
+      std::uint32_t upcLength;
+      std::uint32_t nameLength;
+      int shelfLife;
+    };
+
+    // table - the frozen part, shared between copies
+    struct table
+    {
+      std::string arena;
+      std::vector<entry> entries;
+
+      // hash table of packed UPC codes; ids holds id + 1, 0 for an empty slot
+      std::vector<std::uint64_t> keys;
+      std::vector<int> ids;
+      std::size_t mask;
+      int shift;
+
+      // products whose UPC codes cannot be packed, by code
+      std::map<std::string, int, std::less<> > unpacked;
+    };
+
+    bool frozen;
+    std::shared_ptr<const table> frozenTable;
+
+    // products added before the freeze, or after it (the overlay)
+    std::string pendingArena;
+    std::vector<entry> pending;
+    std::map<std::string, int, std::less<> > pendingIndex;
+
+    // entryOf - returns the arena and entry for an id
+    const entry& entryOf(int id, const std::string*& arena) const;
+  };
+}
+
+#endif
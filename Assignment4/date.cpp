@@ -0,0 +1,88 @@
+//----------------------------------------------
+// date.cpp
+//
+// function definitions for the date helpers declared in date.h
+//----------------------------------------------
+
+#include "date.h"
+
+#include <stdexcept>
+
+namespace reports
+{
+  // abbreviated month names as printed by the report
+  static const char monthNames[12][4] =
+    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  // make_date - checks the fields and converts them to days since 1970-01-01
+  int make_date(int year, int month, int day)
+  {
+    if (year < 1400 || year > 9999)
+      throw std::out_of_range("Year is out of valid range: 1400..9999");
+    if (month < 1 || month > 12)
+      throw std::out_of_range("Month number is out of range 1..12");
+    if (day < 1 || day > 31)
+      throw std::out_of_range("Day of month value is out of range 1..31");
+    if (day > days_in_month(year, month))
+      throw std::out_of_range("Day of month is not valid for year");
+
+    return days_from_civil(year, month, day);
+  }
+
+  // put_year - writes the year with at least four digits, returns the end of the output
+  static char* put_year(int year, char* p)
+  {
+    if (year < 0)
+      {
+	*p++ = '-';
+	year = -year;
+      }
+    char digits[12];
+    int count = 0;
+    do
+      {
+	digits[count++] = char('0' + year % 10);
+	year /= 10;
+      }
+    while (year != 0 || count < 4);
+    while (count > 0)
+      *p++ = digits[--count];
+    return p;
+  }
+
+  // format_date - writes the date as "Mon/D/YYYY"
+  std::size_t format_date(int days, char* out)
+  {
+    civil date = civil_from_days(days);
+    char* p = out;
+
+    const char* name = monthNames[date.month - 1];
+    *p++ = name[0];
+    *p++ = name[1];
+    *p++ = name[2];
+    *p++ = '/';
+
+    if (date.day >= 10)
+      *p++ = char('0' + date.day / 10);
+    *p++ = char('0' + date.day % 10);
+    *p++ = '/';
+
+    // years are always printed with at least four digits
+    p = put_year(date.year, p);
+    return p - out;
+  }
+
+  // format_iso_date - writes the date as "YYYY-MM-DD"
+  std::size_t format_iso_date(int days, char* out)
+  {
+    civil date = civil_from_days(days);
+    char* p = put_year(date.year, out);
+    *p++ = '-';
+    *p++ = char('0' + date.month / 10);
+    *p++ = char('0' + date.month % 10);
+    *p++ = '-';
+    *p++ = char('0' + date.day / 10);
+    *p++ = char('0' + date.day % 10);
+    return p - out;
+  }
+}
@@ -0,0 +1,87 @@
+//--------------------------------------------
+// date.h
+//
+// lightweight calendar date handling, replacing boost::gregorian
+// dates are kept as a single int: days since 1 January 1970 in the proleptic gregorian
+// calendar, so "start date + days since start" is plain integer addition
+// converting between that count and year/month/day is constexpr integer arithmetic
+// (no tables, no allocation), and format_date writes the report's "Mon/D/YYYY" form
+// straight into a caller supplied buffer
+//--------------------------------------------
+
+#ifndef DATE_H
+#define DATE_H
+
+#include <cstddef>
+
+namespace reports
+{
+  // civil - a year/month/day triple, month and day counted from 1
+  struct civil
+  {
+    int year;
+    int month;
+    int day;
+  };
+
+  // days_from_civil - returns days since 1970-01-01 for the given date
+  // eras of 400 years repeat exactly, and counting the year from March puts the leap
+  // day at the end of the year, so the day of the year is a linear function of month
+  constexpr int days_from_civil(int year, int month, int day)
+  {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+  }
+
+  // civil_from_days - inverse of days_from_civil
+  constexpr civil civil_from_days(int days)
+  {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int dayOfEra = days - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int shiftedMonth = (5 * dayOfYear + 2) / 153;
+    int day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    int month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    civil result = { yearOfEra + era * 400 + (month <= 2), month, day };
+    return result;
+  }
+
+  // days_in_month - returns the length of the month in the given year
+  constexpr int days_in_month(int year, int month)
+  {
+    return month == 2
+      ? ((year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 29 : 28)
+      : (month == 4 || month == 6 || month == 9 || month == 11) ? 30 : 31;
+  }
+
+  // compile time checks of the conversions
+  static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+  static_assert(days_from_civil(2010, 5, 1) == 14730, "days_from_civil");
+  static_assert(civil_from_days(14730).year == 2010 && civil_from_days(14730).month == 5
+		&& civil_from_days(14730).day == 1, "civil_from_days");
+  static_assert(civil_from_days(days_from_civil(2000, 2, 29) + 1).month == 3, "leap day");
+
+  // make_date - checks the fields and converts them to days since 1970-01-01
+  // throws std::out_of_range with boost::gregorian's messages for a year outside
+  // 1400..9999, a bad month or a bad day
+  int make_date(int year, int month, int day);
+
+  // format_date - writes the date as "Mon/D/YYYY" (e.g. "May/1/2010")
+  // parameter - out - buffer of at least 16 characters
+  // returns - number of characters written
+  std::size_t format_date(int days, char* out);
+
+  // format_iso_date - writes the date as "YYYY-MM-DD" (e.g. "2010-05-01"), for the
+  // machine readable report formats
+  // parameter - out - buffer of at least 16 characters
+  // returns - number of characters written
+  std::size_t format_iso_date(int days, char* out);
+}
+
+#endif
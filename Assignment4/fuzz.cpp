@@ -0,0 +1,1227 @@
+//--------------------------------------------
+// fuzz.cpp
+//
+// differential fuzzer for the inventory engines and the log parser
+//
+// built with libFuzzer:
+//   clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -DREPORTS_LIBFUZZER
+//       fuzz.cpp reference.cpp node.cpp shelf.cpp warehouse.cpp sketch.cpp history.cpp -o fuzz
+//   ./fuzz
+// or as a stand alone random tester:
+//   g++ -std=c++17 -O2 -pthread fuzz.cpp reference.cpp node.cpp shelf.cpp warehouse.cpp sketch.cpp
+//       history.cpp shard.cpp block_reader.cpp report_writer.cpp date.cpp -o fuzz
+//   ./fuzz [iterations] [seed]
+//   run from this directory with the report built as README.txt shows (or its path in
+//   $REPORT_BINARY): one fixed case checks the report's output for data1.txt
+//
+// the first input byte picks the target:
+// - even: the bytes are decoded into a catalog and a sequence of receives, requests and
+//   next days, which is replayed against reference_warehouse and every engine listed in
+//   make_engines; the full state of every warehouse (lots, busiest day, transactions,
+//   shortfall, stocked flags and quantities on hand) is compared after each day and at the end;
+//   the engines keep top list sketches with a slot for every product, which makes them
+//   exact, so they must list the reference's requested and expired totals; the run is
+//   also kept in an inventory_history for k = 1, 2, 3 and 7, whose onHand for every
+//   past day must be the reference's quantity at the end of that day
+// - odd: the bytes are treated as log text, and every line is cut both by the generated
+//   parser (record.h) and by reference_parse; they must throw on the same lines and
+//   agree on every field, and no field may point outside its line
+// any difference aborts with a description of it
+// the stand alone driver first runs a few fixed cases, inputs which once went wrong
+//--------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "record.h"
+#include "reference.h"
+#include "warehouse.h"
+#include "sketch.h"
+#include "shard.h"
+#include "block_reader.h"
+#include "history.h"
+#include "date.h"
+#include "node.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef std::map<std::string, std::vector<std::pair<int, int> > > inventory;
+typedef std::vector<std::pair<std::string, long long> > top_list;
+
+// fail - reports a difference and stops
+static void fail(const std::string& what)
+{
+  std::fprintf(stderr, "fuzz: %s\n", what.c_str());
+  std::abort();
+}
+
+//--- engines ---//
+
+// engine - one warehouse of some inventory implementation, as driven by the fuzzer
+class engine
+{
+public:
+  virtual ~engine() {}
+  virtual void receiveToShelf(const std::string& upc, int qty, int currentDate, int shelfLife) = 0;
+  virtual void requestToShelf(const std::string& upc, int qty) = 0;
+  // transferToShelf - destination is an engine of the same kind
+  virtual int transferToShelf(const std::string& upc, int qty, engine& destination) = 0;
+  virtual void advanceDay(int dayVal) = 0;
+  virtual bool isStocked(const std::string& upc) = 0;
+  virtual long long onHand(const std::string& upc) = 0;
+  virtual long long getShortfall() = 0;
+  virtual int getBusiestDay() = 0;
+  virtual int getHighestTransactions() = 0;
+  virtual int getCurrentTransactions() = 0;
+  virtual void contents(inventory& out) = 0;
+  virtual void topLists(top_list& requested, top_list& expired) = 0;
+};
+
+// top_sketches - the sketch size the engines use: a slot for each of the (at most 8)
+// products
+static reports::sketch_config top_sketches()
+{
+  reports::sketch_config config;
+  config.k = 8;
+  return config;
+}
+
+// start_tops, read_tops - the top lists of either kind of warehouse
+static void start_tops(reports::reference_warehouse&)
+{
+}
+static void start_tops(reports::warehouse& house)
+{
+  house.trackHeavyHitters(top_sketches());
+}
+static void read_tops(reports::reference_warehouse& house, top_list& requested, top_list& expired)
+{
+  house.topLists(requested, expired);
+}
+static void read_tops(reports::warehouse& house, top_list& requested, top_list& expired)
+{
+  house.getTopRequested()->top(requested);
+  house.getTopExpired()->top(expired);
+}
+
+// engine_adapter - wraps any class with the warehouse member functions
+template <class Warehouse>
+class engine_adapter : public engine
+{
+public:
+  engine_adapter()
+  {
+    start_tops(house);
+  }
+
+  void receiveToShelf(const std::string& upc, int qty, int currentDate, int shelfLife)
+  {
+    house.receiveToShelf(upc, qty, currentDate, shelfLife);
+  }
+  void requestToShelf(const std::string& upc, int qty)
+  {
+    house.requestToShelf(upc, qty);
+  }
+  int transferToShelf(const std::string& upc, int qty, engine& destination)
+  {
+    return house.transferToShelf(upc, qty, static_cast<engine_adapter&>(destination).house);
+  }
+  void advanceDay(int dayVal)
+  {
+    house.advanceDay(dayVal);
+  }
+  bool isStocked(const std::string& upc)
+  {
+    return house.isStocked(upc);
+  }
+  long long onHand(const std::string& upc)
+  {
+    return house.onHand(upc);
+  }
+  long long getShortfall()
+  {
+    return house.getShortfall();
+  }
+  int getBusiestDay()
+  {
+    return house.getBusiestDay();
+  }
+  int getHighestTransactions()
+  {
+    return house.getHighestTransactions();
+  }
+  int getCurrentTransactions()
+  {
+    return house.getCurrentTransactions();
+  }
+  void contents(inventory& out)
+  {
+    house.contents(out);
+  }
+  void topLists(top_list& requested, top_list& expired)
+  {
+    read_tops(house, requested, expired);
+  }
+
+private:
+  Warehouse house;
+};
+
+// forked_engine - a warehouse which forks itself at every day boundary and carries on
+// with the fork while the original stays alive, so every change after the first day goes
+// through the copy on write path of warehouse::fork
+// the original is checked to still hold what it held at the fork before it is dropped
+class forked_engine : public engine
+{
+public:
+  forked_engine() : current(new reports::warehouse()), previous(NULL)
+  {
+    start_tops(*current);
+  }
+
+  ~forked_engine()
+  {
+    delete current;
+    delete previous;
+  }
+
+  void receiveToShelf(const std::string& upc, int qty, int currentDate, int shelfLife)
+  {
+    current->receiveToShelf(upc, qty, currentDate, shelfLife);
+  }
+  void requestToShelf(const std::string& upc, int qty)
+  {
+    current->requestToShelf(upc, qty);
+  }
+  int transferToShelf(const std::string& upc, int qty, engine& destination)
+  {
+    return current->transferToShelf(upc, qty, *static_cast<forked_engine&>(destination).current);
+  }
+  void advanceDay(int dayVal)
+  {
+    current->advanceDay(dayVal);
+    if (current->shelfStats().dead != 0)
+      fail("an emptied shelf was left in the map");
+
+    if (previous != NULL)
+      {
+	inventory now;
+	previous->contents(now);
+	if (now != atFork)
+	  fail("forked warehouse changed after its fork");
+	delete previous;
+      }
+
+    atFork.clear();
+    current->contents(atFork);
+    previous = current;
+    current = current->fork();
+  }
+  bool isStocked(const std::string& upc)
+  {
+    return current->isStocked(upc);
+  }
+  long long onHand(const std::string& upc)
+  {
+    return current->onHand(upc);
+  }
+  long long getShortfall()
+  {
+    return current->getShortfall();
+  }
+  int getBusiestDay()
+  {
+    return current->getBusiestDay();
+  }
+  int getHighestTransactions()
+  {
+    return current->getHighestTransactions();
+  }
+  int getCurrentTransactions()
+  {
+    return current->getCurrentTransactions();
+  }
+  void contents(inventory& out)
+  {
+    current->contents(out);
+  }
+  void topLists(top_list& requested, top_list& expired)
+  {
+    read_tops(*current, requested, expired);
+  }
+
+private:
+  reports::warehouse* current;
+  reports::warehouse* previous;
+  inventory atFork;
+};
+
+// engine_maker - a named factory for the engines under test
+struct engine_maker
+{
+  const char* name;
+  std::function<engine*()> make;
+};
+
+// make_engines - every engine compared against the reference
+// new engines (pooled, parallel, batched ...) are added to this list
+static std::vector<engine_maker> make_engines()
+{
+  std::vector<engine_maker> makers;
+  makers.push_back(engine_maker{ "warehouse", [] { return (engine*)new engine_adapter<reports::warehouse>(); } });
+  makers.push_back(engine_maker{ "forked", [] { return (engine*)new forked_engine(); } });
+  return makers;
+}
+
+// history_engine - the warehouses of a run, with an inventory_history committing a version
+// of them every day (a full version every k days, deltas in between)
+// every past day's onHand is checked against the reference's quantities at the end of
+// that day, so both the delta chain and the full versions it starts from are read
+class history_engine
+{
+public:
+  history_engine(int houses, int i_every) : every(i_every), history(i_every)
+  {
+    for (int h = 0; h < houses; h++)
+      {
+	reports::warehouse* house = new reports::warehouse();
+	history.track(house);
+	named.insert(std::make_pair("house " + std::to_string(h), house));
+	warehouses.push_back(house);
+      }
+  }
+
+  ~history_engine()
+  {
+    for (std::size_t h = 0; h < warehouses.size(); h++)
+      delete warehouses[h];
+  }
+
+  reports::warehouse& house(int h)
+  {
+    return *warehouses[h];
+  }
+
+  // advanceDay - ends the day in every warehouse and commits its version
+  void advanceDay(int day)
+  {
+    for (std::size_t h = 0; h < warehouses.size(); h++)
+      warehouses[h]->advanceDay(day);
+    history.commit(day, named);
+  }
+
+  // check - onHand of every day so far against the reference's end of day quantities,
+  // indexed by day, warehouse and product
+  void check(const std::vector<std::vector<std::vector<long long> > >& expected,
+	     const std::vector<std::string>& upcs)
+  {
+    if (history.days() != (int)expected.size())
+      fail("history with k = " + std::to_string(every) + " committed a different number of days");
+    for (std::size_t d = 0; d < expected.size(); d++)
+      for (std::size_t h = 0; h < warehouses.size(); h++)
+	for (std::size_t p = 0; p < upcs.size(); p++)
+	  if (history.onHand((int)d, "house " + std::to_string(h), upcs[p]) != expected[d][h][p])
+	    fail("history with k = " + std::to_string(every) + " differs on day " + std::to_string(d)
+		 + " warehouse " + std::to_string(h) + " for " + upcs[p]);
+  }
+
+private:
+  int every;
+  reports::inventory_history history;
+  std::vector<reports::warehouse*> warehouses;
+  std::map<std::string, reports::warehouse*> named;
+};
+
+// history_intervals - the full version intervals the history engines are run with
+static const int history_intervals[4] = { 1, 2, 3, 7 };
+
+// describe - formats an inventory for failure messages
+static std::string describe(const inventory& stock)
+{
+  std::string text;
+  for (inventory::const_iterator iterator = stock.begin(); iterator != stock.end(); ++iterator)
+    {
+      text += " " + iterator->first + ":";
+      for (std::size_t i = 0; i < iterator->second.size(); i++)
+	text += " (" + std::to_string(iterator->second[i].first) + "," + std::to_string(iterator->second[i].second) + ")";
+    }
+  return text;
+}
+
+// compare - checks one warehouse of an engine against the reference
+static void compare(const char* name, int house, int day, engine& test, engine& reference,
+		    const std::vector<std::string>& upcs)
+{
+  std::string where = std::string(name) + " warehouse " + std::to_string(house) + " day " + std::to_string(day);
+
+  inventory expected, actual;
+  reference.contents(expected);
+  test.contents(actual);
+  if (expected != actual)
+    fail(where + " lots differ\n  reference:" + describe(expected) + "\n  engine:   " + describe(actual));
+
+  if (test.getBusiestDay() != reference.getBusiestDay()
+      || test.getHighestTransactions() != reference.getHighestTransactions()
+      || test.getCurrentTransactions() != reference.getCurrentTransactions())
+    fail(where + " busiest day or transactions differ");
+
+  if (test.getShortfall() != reference.getShortfall())
+    fail(where + " shortfall differs");
+
+  top_list requested, expired, expectedRequested, expectedExpired;
+  test.topLists(requested, expired);
+  reference.topLists(expectedRequested, expectedExpired);
+  if (requested != expectedRequested || expired != expectedExpired)
+    fail(where + " top lists differ");
+
+  for (std::size_t i = 0; i < upcs.size(); i++)
+    {
+      if (test.isStocked(upcs[i]) != reference.isStocked(upcs[i]))
+	fail(where + " isStocked differs for " + upcs[i]);
+      if (test.onHand(upcs[i]) != reference.onHand(upcs[i]))
+	fail(where + " onHand differs for " + upcs[i]);
+    }
+}
+
+// fuzz_transactions - decodes and replays a transaction sequence
+//   byte 1: warehouse count, byte 2: product count, one shelf life byte per product,
+//   then operations: a kind byte followed by a product/warehouse byte and a quantity byte
+//   (kind 7 next day, 0-2 receive, 5 transfer, others request; a transfer goes to the
+//   warehouse picked by the top bits of the product/warehouse byte)
+static void fuzz_transactions(const std::uint8_t* data, std::size_t size)
+{
+  std::size_t at = 1;
+  if (size < at + 2)
+    return;
+  int houses = 1 + data[at++] % 4;
+  int products = 1 + data[at++] % 8;
+
+  std::vector<std::string> upcs;
+  std::vector<int> lives;
+  for (int i = 0; i < products && at < size; i++)
+    {
+      char upc[16];
+      std::snprintf(upc, sizeof(upc), "%010d", 1000 + i);
+      upcs.push_back(upc);
+      lives.push_back(data[at++] % 8);
+    }
+  products = (int)upcs.size();
+  if (products == 0)
+    return;
+
+  std::vector<engine_maker> makers = make_engines();
+  std::vector<std::unique_ptr<engine> > reference;
+  std::vector<std::vector<std::unique_ptr<engine> > > engines(makers.size());
+  for (int h = 0; h < houses; h++)
+    {
+      reference.emplace_back(new engine_adapter<reports::reference_warehouse>());
+      for (std::size_t e = 0; e < makers.size(); e++)
+	engines[e].emplace_back(makers[e].make());
+    }
+
+  // the same run kept in histories, and the reference's quantities at the end of each day
+  std::vector<std::unique_ptr<history_engine> > histories;
+  for (int k = 0; k < 4; k++)
+    histories.emplace_back(new history_engine(houses, history_intervals[k]));
+  std::vector<std::vector<std::vector<long long> > > endOfDay;
+
+  // the days each warehouse last received a huge lot, and how many it has received
+  std::vector<int> hugeDay(houses, -1);
+  std::vector<int> hugeLots(houses, 0);
+
+  int day = 0;
+  while (at + 2 < size)
+    {
+      int kind = data[at] % 8;
+      int product = data[at + 1] % products;
+      int house = (data[at + 1] / 8) % houses;
+      int to = (data[at + 1] / 32) % houses;
+      int qty = data[at + 2] % 32;
+      at += 3;
+
+      if (kind == 7)
+	{
+	  // next day for every warehouse, then compare everything
+	  for (int h = 0; h < houses; h++)
+	    {
+	      reference[h]->advanceDay(day);
+	      for (std::size_t e = 0; e < makers.size(); e++)
+		engines[e][h]->advanceDay(day);
+	    }
+	  for (int h = 0; h < houses; h++)
+	    for (std::size_t e = 0; e < makers.size(); e++)
+	      compare(makers[e].name, h, day, *engines[e][h], *reference[h], upcs);
+
+	  endOfDay.push_back(std::vector<std::vector<long long> >(houses, std::vector<long long>(products)));
+	  for (int h = 0; h < houses; h++)
+	    for (int p = 0; p < products; p++)
+	      endOfDay.back()[h][p] = reference[h]->onHand(upcs[p]);
+	  for (std::size_t k = 0; k < histories.size(); k++)
+	    histories[k]->advanceDay(day);
+	  day++;
+	}
+      else if (kind < 3)
+	{
+	  // receives, sometimes large, rarely negative (which shelf::request must not
+	  // drain in bulk) and rarely huge: two huge lots add up past an int, but a day's
+	  // transactions and a lot must not, so a warehouse gets at most one a day and two
+	  // in all
+	  if (kind == 2 && qty == 31 && hugeDay[house] != day && hugeLots[house] < 2)
+	    {
+	      qty = 1200000000;
+	      hugeDay[house] = day;
+	      hugeLots[house]++;
+	    }
+	  else if (kind == 2)
+	    qty *= 16;
+	  else if (kind == 1 && qty == 31)
+	    qty = -7;
+	  // odd warehouses keep a product 4 days longer, so stock transferred from them can
+	  // outlive what the destination receives afterwards
+	  int life = lives[product] + house % 2 * 4;
+	  reference[house]->receiveToShelf(upcs[product], qty, day, life);
+	  for (std::size_t e = 0; e < makers.size(); e++)
+	    engines[e][house]->receiveToShelf(upcs[product], qty, day, life);
+	  for (std::size_t k = 0; k < histories.size(); k++)
+	    histories[k]->house(house).receiveToShelf(upcs[product], qty, day, life);
+	}
+      else if (kind == 5)
+	{
+	  // transfers, sometimes between a warehouse and itself
+	  int moved = reference[house]->transferToShelf(upcs[product], qty, *reference[to]);
+	  for (std::size_t e = 0; e < makers.size(); e++)
+	    if (engines[e][house]->transferToShelf(upcs[product], qty, *engines[e][to]) != moved)
+	      fail(std::string(makers[e].name) + " moved a different quantity");
+	  for (std::size_t k = 0; k < histories.size(); k++)
+	    histories[k]->house(house).transferToShelf(upcs[product], qty, histories[k]->house(to));
+	}
+      else
+	{
+	  // requests, sometimes larger than anything on hand
+	  if (kind == 6)
+	    qty *= 64;
+	  reference[house]->requestToShelf(upcs[product], qty);
+	  for (std::size_t e = 0; e < makers.size(); e++)
+	    engines[e][house]->requestToShelf(upcs[product], qty);
+	  for (std::size_t k = 0; k < histories.size(); k++)
+	    histories[k]->house(house).requestToShelf(upcs[product], qty);
+	}
+    }
+
+  for (int h = 0; h < houses; h++)
+    for (std::size_t e = 0; e < makers.size(); e++)
+      compare(makers[e].name, h, day, *engines[e][h], *reference[h], upcs);
+  for (std::size_t k = 0; k < histories.size(); k++)
+    histories[k]->check(endOfDay, upcs);
+}
+
+//--- parser ---//
+
+// field_recorder - record handler which keeps what parse_record cut out of the line
+struct field_recorder
+{
+  std::string_view line;
+  reports::reference_record record;
+
+  // inside - checks a field lies within the line being parsed
+  void inside(std::string_view field)
+  {
+    if (field.size() != 0 && (field.data() < line.data() || field.data() + field.size() > line.data() + line.size()))
+      fail("parser field points outside its line");
+  }
+
+  void foodItem(std::string_view upc, int life, std::string_view name)
+  {
+    inside(upc);
+    inside(name);
+    record.kind = "Foo";
+    record.upc = upc;
+    record.number = life;
+    record.name = name;
+  }
+
+  void warehouse(std::string_view name)
+  {
+    inside(name);
+    record.kind = "War";
+    record.name = name;
+  }
+
+  void start(std::string_view month, std::string_view day, std::string_view year)
+  {
+    inside(month);
+    inside(day);
+    inside(year);
+    record.kind = "Sta";
+    record.month = month;
+    record.day = day;
+    record.year = year;
+  }
+
+  void receive(std::string_view upc, int qty, std::string_view name)
+  {
+    inside(upc);
+    inside(name);
+    record.kind = "Rec";
+    record.upc = upc;
+    record.number = qty;
+    record.name = name;
+  }
+
+  void request(std::string_view upc, int qty, std::string_view name)
+  {
+    inside(upc);
+    inside(name);
+    record.kind = "Req";
+    record.upc = upc;
+    record.number = qty;
+    record.name = name;
+  }
+
+  void transfer(std::string_view upc, int qty, std::string_view names, std::size_t trim)
+  {
+    inside(upc);
+    inside(names);
+    record.kind = "Tra";
+    record.upc = upc;
+    record.number = qty;
+    record.name = names;
+    record.trim = (int)trim;
+  }
+
+  void nextDay()
+  {
+    record.kind = "Nex";
+  }
+};
+
+// fuzz_parser - cuts every line both ways and compares
+static void fuzz_parser(const std::uint8_t* data, std::size_t size)
+{
+  std::string text(reinterpret_cast<const char*>(data) + 1, size - 1);
+  std::size_t begin = 0;
+  while (begin <= text.size())
+    {
+      std::size_t end = text.find('\n', begin);
+      if (end == std::string::npos)
+	end = text.size();
+      std::string line = text.substr(begin, end - begin);
+      begin = end + 1;
+
+      reports::reference_record expected;
+      bool expectedThrew = false;
+      try
+	{
+	  reports::reference_parse(line, expected);
+	}
+      catch (std::out_of_range&)
+	{
+	  expectedThrew = true;
+	}
+
+      field_recorder actual;
+      actual.line = line;
+      actual.record.number = 0;
+      actual.record.trim = 0;
+      bool actualThrew = false;
+      bool more = true;
+      try
+	{
+	  more = reports::parse_record<reports::standard_format>(line, actual);
+	}
+      catch (std::out_of_range&)
+	{
+	  actualThrew = true;
+	}
+      if (!more)
+	actual.record.kind = "End";
+
+      if (expectedThrew != actualThrew)
+	fail("parser and reference disagree on throwing for \"" + line + "\"");
+      if (expectedThrew)
+	continue;
+
+      // atoi saturates where parse_count wraps, so only compare quantities in int range
+      bool numbersComparable = expected.number > -1000000000 && expected.number < 1000000000;
+      if (expected.kind != actual.record.kind || expected.upc != actual.record.upc
+	  || expected.name != actual.record.name || expected.month != actual.record.month
+	  || expected.day != actual.record.day || expected.year != actual.record.year
+	  || expected.trim != actual.record.trim
+	  || (numbersComparable && expected.number != actual.record.number))
+	fail("parser and reference disagree on \"" + line + "\"");
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+  if (size == 0)
+    return 0;
+  if (data[0] & 1)
+    fuzz_parser(data, size);
+  else
+    fuzz_transactions(data, size);
+  return 0;
+}
+
+#ifndef REPORTS_LIBFUZZER
+
+// sample lines the random parser inputs are cut and mutated from
+static const char* samples[] =
+  {
+    "FoodItem - UPC Code: 0353264991  Shelf life: 2  Name: chestnut puree with vanilla\r",
+    "Warehouse - Columbus\r",
+    "Start date: 05/01/2010\r",
+    "Receive: 0984523912 7 Tacoma\r",
+    "Request: 0984523912 5 Tacoma\r",
+    "Transfer: 0984523912 3 Tacoma Ann Arbor\r",
+    "Transfer: 0984523912 3 Tacoma Ann Arbor",
+    "Warehouse - Ann Arbor",
+    "Next day:\r",
+    "End\r"
+  };
+
+// random_log - builds log text from sample lines, truncated, extended or with bytes flipped
+static std::vector<std::uint8_t> random_log(std::mt19937& random)
+{
+  std::vector<std::uint8_t> data(1, 1);
+  int lines = 1 + random() % 16;
+  for (int i = 0; i < lines; i++)
+    {
+      std::string line = samples[random() % (sizeof(samples) / sizeof(samples[0]))];
+      switch (random() % 4)
+	{
+	case 0:
+	  line.resize(random() % (line.size() + 1));
+	  break;
+	case 1:
+	  line.insert(random() % (line.size() + 1), std::string(1 + random() % 12, random() % 2 ? ' ' : '9'));
+	  break;
+	case 2:
+	  line[random() % line.size()] = char(random() % 256);
+	  break;
+	}
+      data.insert(data.end(), line.begin(), line.end());
+      data.push_back('\n');
+    }
+  return data;
+}
+
+//--- fixed cases ---//
+
+// large_lots - two lots whose sum does not fit an int, then a small request; the shelf's
+// total once wrapped negative here and the request drained the whole shelf
+static void large_lots()
+{
+  std::vector<std::string> upcs(1, "0000001000");
+  std::vector<engine_maker> makers = make_engines();
+  for (std::size_t e = 0; e < makers.size(); e++)
+    {
+      engine_adapter<reports::reference_warehouse> reference;
+      std::unique_ptr<engine> test(makers[e].make());
+      engine* both[2] = { &reference, test.get() };
+      for (int i = 0; i < 2; i++)
+	{
+	  both[i]->receiveToShelf(upcs[0], 2000000000, 0, 10);
+	  both[i]->advanceDay(0);
+	  both[i]->receiveToShelf(upcs[0], 2000000000, 1, 10);
+	  both[i]->requestToShelf(upcs[0], 1);
+	  both[i]->advanceDay(1);
+	}
+      compare(makers[e].name, 0, 1, *test, reference, upcs);
+      if (test->onHand(upcs[0]) != 3999999999ll)
+	fail(std::string(makers[e].name) + " lost stock on a shelf holding more than an int");
+    }
+}
+
+// spare_nodes - a shelf with more lots than the spare node list keeps is drained in one
+// request; the nodes past node::spare_limit must be deleted rather than kept, and many
+// shelves emptied one at a time afterwards must not take the list past the limit either
+static void spare_nodes()
+{
+  const int days = (int)reports::node::spare_limit * 3;
+  reports::warehouse house;
+  for (int day = 0; day < days; day++)
+    {
+      house.receiveToShelf("0000001000", 1, day, days + 10);
+      house.advanceDay(day);
+    }
+
+  long long deleted = reports::node::destructor_count();
+  house.requestToShelf("0000001000", days);
+  deleted = reports::node::destructor_count() - deleted;
+  if (deleted < days - reports::node::spare_limit)
+    fail("a drain of " + std::to_string(days) + " lots deleted only " + std::to_string(deleted)
+	 + " nodes");
+  if (reports::node::spare_count() > reports::node::spare_limit)
+    fail("the spare node list holds " + std::to_string(reports::node::spare_count()) + " nodes");
+
+  std::vector<std::string> upcs;
+  for (int i = 0; i < days; i++)
+    {
+      upcs.push_back(std::to_string(2000000000 + i));
+      house.receiveToShelf(upcs.back(), 1, days, 10);
+    }
+  for (std::size_t i = 0; i < upcs.size(); i++)
+    house.requestToShelf(upcs[i], 1);
+  if (reports::node::spare_count() > reports::node::spare_limit)
+    fail("the spare node list holds " + std::to_string(reports::node::spare_count())
+	 + " nodes after shelves were emptied one at a time");
+}
+
+// record_line - parses one line with the generated parser
+static reports::reference_record record_line(const std::string& line)
+{
+  field_recorder recorder;
+  recorder.line = line;
+  recorder.record.number = 0;
+  recorder.record.trim = 0;
+  reports::parse_record<reports::standard_format>(line, recorder);
+  return recorder.record;
+}
+
+// upc12_fields - lines of a 12 digit UPC log, cut with the upc12_format descriptors
+static void upc12_fields()
+{
+  struct sample
+  {
+    const char* line;
+    const char* kind;
+    const char* upc;
+    int number;
+    const char* name;
+  };
+  const sample samples[4] =
+    {
+      { "FoodItem - UPC Code: 035326499123  Shelf life: 12  Name: chestnut puree\r", "Foo", "035326499123", 12, "chestnut puree" },
+      { "Receive: 098452391245 7 Tacoma\r", "Rec", "098452391245", 7, "Tacoma" },
+      { "Request: 098452391245 15 Ann Arbor\r", "Req", "098452391245", 15, "Ann Arbor" },
+      { "Transfer: 098452391245 3 Tacoma Ann Arbor\r", "Tra", "098452391245", 3, "Tacoma Ann Arbor" }
+    };
+  for (int i = 0; i < 4; i++)
+    {
+      field_recorder recorder;
+      recorder.line = samples[i].line;
+      recorder.record.number = 0;
+      recorder.record.trim = 0;
+      reports::parse_record<reports::upc12_format>(recorder.line, recorder);
+      if (recorder.record.kind != samples[i].kind || recorder.record.upc != samples[i].upc
+	  || recorder.record.number != samples[i].number || recorder.record.name != samples[i].name)
+	fail(std::string("upc12_format cut \"") + samples[i].line + "\" wrongly");
+    }
+}
+
+// transfer_names - a Transfer between warehouses whose names hold spaces, in a CRLF and
+// in an LF log; its halves must be the names the Warehouse lines declared (in an LF log
+// those lost their last character, and the from half once did not)
+static void transfer_names()
+{
+  const char* endings[2] = { "\r", "" };
+  for (int e = 0; e < 2; e++)
+    {
+      std::string ending = endings[e];
+      std::set<std::string> declared;
+      std::string tacoma = record_line("Warehouse - Tacoma" + ending).name;
+      std::string annArbor = record_line("Warehouse - Ann Arbor" + ending).name;
+      declared.insert(tacoma);
+      declared.insert(annArbor);
+      declared.insert(record_line("Warehouse - Ann" + ending).name);
+
+      const char* lines[2] = { "Transfer: 0984523912 3 Tacoma Ann Arbor", "Transfer: 0984523912 3 Ann Arbor Tacoma" };
+      for (int l = 0; l < 2; l++)
+	{
+	  reports::reference_record record = record_line(lines[l] + ending);
+	  std::string_view from;
+	  std::string_view to;
+	  if (!reports::split_names(record.name, record.trim,
+				    [&declared](std::string_view name) { return declared.count(std::string(name)) != 0; },
+				    from, to)
+	      || from != (l == 0 ? tacoma : annArbor) || to != (l == 0 ? annArbor : tacoma))
+	    fail(std::string("transfer names split wrongly in an ") + (e == 0 ? "CRLF" : "LF") + " log: \"" + lines[l] + "\"");
+	}
+    }
+}
+
+// message_reader - a stand in for report.cpp's log_reader which only diagnoses: a receive
+// or request naming an undeclared product or warehouse, and a transfer whose names are
+// not two warehouses, are kept by line number as log_reader keeps them in a shard worker
+struct message_reader
+{
+  long long lineNumber;
+  std::set<std::string, std::less<> > foods;
+  std::set<std::string, std::less<> > houses;
+  std::map<long long, std::vector<std::string> > messages;
+
+  message_reader() : lineNumber(0) {}
+
+  void foodItem(std::string_view upc, int, std::string_view)
+  {
+    foods.insert(std::string(upc));
+  }
+  void warehouse(std::string_view name)
+  {
+    houses.insert(std::string(name));
+  }
+  void start(std::string_view, std::string_view, std::string_view) {}
+  void nextDay() {}
+
+  void check(const char* record, std::string_view upc, std::string_view name)
+  {
+    if (foods.find(upc) == foods.end() || houses.find(name) == houses.end())
+      messages[lineNumber].push_back(std::string(record) + " " + std::string(upc) + " " + std::string(name));
+  }
+  void receive(std::string_view upc, int, std::string_view name)
+  {
+    check("receive", upc, name);
+  }
+  void request(std::string_view upc, int, std::string_view name)
+  {
+    check("request", upc, name);
+  }
+  void transfer(std::string_view upc, int, std::string_view names, std::size_t trim)
+  {
+    std::string_view from;
+    std::string_view to;
+    const std::set<std::string, std::less<> >& known = houses;
+    if (!reports::split_names(names, trim, [&known](std::string_view name) { return known.find(name) != known.end(); }, from, to))
+      messages[lineNumber].push_back("transfer " + std::string(upc) + " " + std::string(names));
+  }
+
+  // read - every line of a log, numbered as read_log numbers them
+  void read(const std::string& fileName)
+  {
+    reports::block_reader readFile(fileName);
+    std::string_view line;
+    while (readFile.getline(line))
+      {
+	lineNumber++;
+	long long number;
+	if (reports::line_marker(line, number))
+	  lineNumber = number - 1;
+	else if (!reports::parse_record<reports::standard_format>(line, *this))
+	  break;
+      }
+  }
+};
+
+// shard_messages - a log with bad lines (undeclared products and warehouses, and
+// transfers naming no warehouses, which every shard replays) is run through run_shards;
+// the merged diagnostics must be a single run's, in the same order and none twice
+// then a transfer between warehouses of different shards is added: the run must stop at
+// the split, printing that line's number and nothing else (no worker failure after it)
+static void shard_messages()
+{
+  const char* tmp = getenv("TMPDIR");
+  std::string pattern = std::string(tmp != NULL ? tmp : "/tmp") + "/fuzz-shards-XXXXXX";
+  std::vector<char> directory(pattern.begin(), pattern.end());
+  directory.push_back('\0');
+  if (mkdtemp(&directory[0]) == NULL)
+    fail("cannot make a directory for shard_messages");
+  std::string logName = std::string(&directory[0]) + "/bad.log";
+
+  const char* houses[5] = { "Columbus", "Tacoma", "Ann Arbor", "Scottsdale", "Wichita Falls" };
+  const char* upcs[4] = { "0000001000", "0000001001", "0000001002", "9999999999" };
+  std::mt19937 random(5);
+  {
+    std::ofstream log(logName.c_str());
+    for (int f = 0; f < 3; f++)
+      log << "FoodItem - UPC Code: " << upcs[f] << "  Shelf life: 3  Name: food " << f << "\r\n";
+    for (int h = 0; h < 5; h++)
+      log << "Warehouse - " << houses[h] << "\r\n";
+    log << "Start date: 05/01/2010\r\n";
+    for (int i = 0; i < 600; i++)
+      {
+	// undeclared products are the fourth code, undeclared warehouses "Nowhere"
+	std::string upc = upcs[random() % 4];
+	std::string house = random() % 8 == 0 ? "Nowhere" : houses[random() % 5];
+	switch (random() % 5)
+	  {
+	  case 0:
+	    log << "Receive: " << upc << " 5 " << house << "\r\n";
+	    break;
+	  case 1:
+	    log << "Request: " << upc << " 2 " << house << "\r\n";
+	    break;
+	  case 2:
+	    // within one warehouse (always one shard), or between names that are not both
+	    // warehouses
+	    if (random() % 2 == 0)
+	      log << "Transfer: " << upc << " 1 " << house << " " << house << "\r\n";
+	    else
+	      log << "Transfer: " << upc << " 1 Nowhere Elsewhere\r\n";
+	    break;
+	  default:
+	    log << "Next day:\r\n";
+	  }
+      }
+    log << "End\r\n";
+  }
+
+  message_reader single;
+  single.read(logName);
+  reports::shard_result expected;
+  expected.messages = single.messages;
+  std::ostringstream expectedText;
+  expected.printMessages(expectedText);
+  if (expected.messages.empty())
+    fail("shard_messages made no bad lines");
+
+  const int counts[3] = { 2, 3, 5 };
+  for (int c = 0; c < 3; c++)
+    {
+      reports::shard_result merged;
+      bool ok = reports::run_shards(logName, counts[c],
+				    [](int, const std::string& shardLog, const std::string& resultFile)
+				    {
+				      message_reader reader;
+				      reader.read(shardLog);
+				      reports::shard_result part;
+				      part.messages = reader.messages;
+				      return part.write(resultFile) ? 0 : 1;
+				    },
+				    merged);
+      std::ostringstream mergedText;
+      merged.printMessages(mergedText);
+      if (!ok || mergedText.str() != expectedText.str())
+	fail(std::to_string(counts[c]) + " shards print different diagnostics than a single run");
+    }
+
+  // a small log whose last transfer is between the first two warehouses on different
+  // shards of 2
+  int from = 0;
+  int to = 1;
+  while (reports::shard_of(houses[to], 2) == reports::shard_of(houses[from], 2))
+    to++;
+  std::string crossName = std::string(&directory[0]) + "/cross.log";
+  long long crossing = 0;
+  {
+    std::ofstream log(crossName.c_str());
+    log << "FoodItem - UPC Code: " << upcs[0] << "  Shelf life: 3  Name: food 0\r\n";
+    for (int h = 0; h < 5; h++)
+      log << "Warehouse - " << houses[h] << "\r\n";
+    log << "Start date: 05/01/2010\r\n";
+    log << "Receive: " << upcs[0] << " 5 " << houses[from] << "\r\n";
+    log << "Transfer: " << upcs[0] << " 1 " << houses[from] << " " << houses[from] << "\r\n";
+    log << "Transfer: " << upcs[0] << " 1 " << houses[from] << " " << houses[to] << "\r\n";
+    crossing = 1 + 5 + 1 + 1 + 1 + 1;
+    log << "Next day:\r\n";
+    log << "End\r\n";
+  }
+
+  // run_shards prints on standard output, which goes to a file meanwhile
+  std::string outputName = std::string(&directory[0]) + "/output";
+  std::cout.flush();
+  int saved = dup(1);
+  int output = open(outputName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2(output, 1);
+  close(output);
+  reports::shard_result merged;
+  bool ok = reports::run_shards(crossName, 2,
+				[](int, const std::string&, const std::string& resultFile)
+				{
+				  return reports::shard_result().write(resultFile) ? 0 : 1;
+				},
+				merged);
+  std::cout.flush();
+  dup2(saved, 1);
+  close(saved);
+
+  std::vector<std::string> printed;
+  {
+    std::ifstream file(outputName.c_str());
+    std::string line;
+    while (std::getline(file, line))
+      printed.push_back(line);
+  }
+  std::string splitError = "cannot split line " + std::to_string(crossing) + ": ";
+  if (ok || printed.size() != 1 || printed[0].compare(0, splitError.size(), splitError) != 0)
+    fail("a transfer between shards is not reported as one split error for its line");
+
+  std::remove(outputName.c_str());
+  std::remove(crossName.c_str());
+  std::remove(logName.c_str());
+  rmdir(&directory[0]);
+}
+
+// busiest_reader - a stand in for report.cpp's log_reader which replays the log on
+// reference warehouses, for the busiest day of each
+struct busiest_reader
+{
+  reports::civil startLine;
+  int daysSinceStart;
+  std::map<std::string, int, std::less<> > foods;
+  std::map<std::string, reports::reference_warehouse, std::less<> > houses;
+
+  busiest_reader() : daysSinceStart(0)
+  {
+    startLine.year = startLine.month = startLine.day = 0;
+  }
+
+  void foodItem(std::string_view upc, int life, std::string_view)
+  {
+    foods.insert(std::make_pair(std::string(upc), life));
+  }
+  void warehouse(std::string_view name)
+  {
+    houses[std::string(name)];
+  }
+  void start(std::string_view month, std::string_view day, std::string_view year)
+  {
+    startLine.year = reports::parse_count(year);
+    startLine.month = reports::parse_count(month);
+    startLine.day = reports::parse_count(day);
+  }
+  void receive(std::string_view upc, int qty, std::string_view name)
+  {
+    auto food = foods.find(upc);
+    auto house = houses.find(name);
+    if (food != foods.end() && house != houses.end())
+      house->second.receiveToShelf(std::string(upc), qty, daysSinceStart, food->second);
+  }
+  void request(std::string_view upc, int qty, std::string_view name)
+  {
+    auto house = houses.find(name);
+    if (house != houses.end())
+      house->second.requestToShelf(std::string(upc), qty);
+  }
+  void transfer(std::string_view upc, int qty, std::string_view names, std::size_t trim)
+  {
+    std::string_view from;
+    std::string_view to;
+    const std::map<std::string, reports::reference_warehouse, std::less<> >& known = houses;
+    if (reports::split_names(names, trim, [&known](std::string_view name) { return known.find(name) != known.end(); }, from, to))
+      houses.find(from)->second.transferToShelf(std::string(upc), qty, houses.find(to)->second);
+  }
+  void nextDay()
+  {
+    for (auto iterator = houses.begin(); iterator != houses.end(); ++iterator)
+      iterator->second.advanceDay(daysSinceStart);
+    daysSinceStart++;
+  }
+};
+
+// report_lines - runs the report binary (./report, or $REPORT_BINARY) with the arguments
+// and returns its output lines
+static std::vector<std::string> report_lines(const std::string& arguments)
+{
+  const char* binary = getenv("REPORT_BINARY");
+  std::string command = std::string(binary != NULL ? binary : "./report") + " " + arguments;
+  FILE* output = popen(command.c_str(), "r");
+  if (output == NULL)
+    fail("cannot run " + command);
+
+  std::vector<std::string> lines;
+  std::string line;
+  int c;
+  while ((c = fgetc(output)) != EOF)
+    if (c == '\n')
+      {
+	lines.push_back(line);
+	line.clear();
+      }
+    else
+      line.push_back((char)c);
+  if (pclose(output) != 0)
+    fail(command + " failed (build the report as README.txt shows, or set REPORT_BINARY)");
+  return lines;
+}
+
+// busiest_dates - the CSV and JSON lines reports of data1.txt must date each warehouse's
+// busiest day from the Start line's month, day and year; they once used the start date
+// the text report combines from the day and year fields (2010-01-20 for 05/01/2010)
+static void busiest_dates()
+{
+  busiest_reader reader;
+  {
+    reports::block_reader readFile("data1.txt");
+    std::string_view line;
+    while (readFile.getline(line) && reports::parse_record<reports::standard_format>(line, reader))
+      ;
+  }
+  if (reader.houses.empty() || reader.startLine.year == 0)
+    fail("busiest_dates needs data1.txt in the working directory");
+
+  std::map<std::string, std::string> expected;
+  int start = reports::days_from_civil(reader.startLine.year, reader.startLine.month, reader.startLine.day);
+  for (auto iterator = reader.houses.begin(); iterator != reader.houses.end(); ++iterator)
+    {
+      char date[16];
+      std::size_t length = reports::format_iso_date(start + iterator->second.getBusiestDay(), date);
+      expected[iterator->first] = std::string(date, length);
+    }
+
+  // CSV rows are warehouse,,<name>,,,<date>,<transactions>
+  std::map<std::string, std::string> csv;
+  std::vector<std::string> lines = report_lines("--format csv data1.txt");
+  for (std::size_t i = 0; i < lines.size(); i++)
+    if (lines[i].compare(0, 11, "warehouse,,") == 0)
+      {
+	std::string::size_type end = lines[i].find(",,,", 11);
+	if (end != std::string::npos)
+	  csv[lines[i].substr(11, end - 11)] = lines[i].substr(end + 3, 10);
+      }
+  if (csv != expected)
+    fail("the CSV report of data1.txt dates the busiest days wrongly");
+
+  std::map<std::string, std::string> jsonl;
+  const std::string nameKey = "{\"record\":\"warehouse\",\"name\":\"";
+  const std::string dayKey = "\",\"busiest_day\":\"";
+  lines = report_lines("--format jsonl data1.txt");
+  for (std::size_t i = 0; i < lines.size(); i++)
+    if (lines[i].compare(0, nameKey.size(), nameKey) == 0)
+      {
+	std::string::size_type end = lines[i].find(dayKey, nameKey.size());
+	if (end != std::string::npos)
+	  jsonl[lines[i].substr(nameKey.size(), end - nameKey.size())] = lines[i].substr(end + dayKey.size(), 10);
+      }
+  if (jsonl != expected)
+    fail("the JSON lines report of data1.txt dates the busiest days wrongly");
+}
+
+// stand alone driver: the fixed cases, then random transaction streams and random logs
+// alternately
+int main(int argc, char* argv[])
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  unsigned seed = argc > 2 ? (unsigned)atol(argv[2]) : 1;
+  std::mt19937 random(seed);
+
+  large_lots();
+  spare_nodes();
+  transfer_names();
+  upc12_fields();
+  shard_messages();
+  busiest_dates();
+
+  for (long i = 0; i < iterations; i++)
+    {
+      std::vector<std::uint8_t> data;
+      if (i % 2 == 0)
+	{
+	  data.resize(1 + random() % 512);
+	  for (std::size_t b = 0; b < data.size(); b++)
+	    data[b] = (std::uint8_t)random();
+	  data[0] &= 0xfe;
+	}
+      else
+	data = random_log(random);
+
+      LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+  std::printf("fuzz: %ld inputs, no differences\n", iterations);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,103 @@
+//----------------------------------------------
+// history.cpp
+//
+// class function definitions for inventory_history
+// a more detailed description can be found in history.h
+//----------------------------------------------
+
+#include "history.h"
+
+namespace reports
+{
+  inventory_history::inventory_history(int every)
+    : every(every < 1 ? 1 : every), committed(0)
+  {
+  }
+
+  inventory_history::~inventory_history()
+  {
+    typedef std::map<int, std::map<std::string, warehouse*> >::iterator versionWalk;
+    typedef std::map<std::string, warehouse*>::iterator walkThrough;
+    for (versionWalk version = full.begin(); version != full.end(); ++version)
+      for (walkThrough iterator = version->second.begin(); iterator != version->second.end(); ++iterator)
+	delete iterator->second;
+  }
+
+  void inventory_history::track(warehouse* house)
+  {
+    house->trackChanges();
+  }
+
+  // commit - a full version forks every warehouse, a delta reads the quantities of the
+  // changed shelves; either way the change sets are emptied for the next day
+  void inventory_history::commit(int day, const std::map<std::string, warehouse*>& houses)
+  {
+    typedef std::map<std::string, warehouse*>::const_iterator walkThrough;
+    bool isFull = day % every == 0;
+
+    std::map<std::string, warehouse*>* forks = isFull ? &full[day] : NULL;
+    std::vector<std::string> changes;
+    for (walkThrough iterator = houses.begin(); iterator != houses.end(); ++iterator)
+      {
+	changes.clear();
+	iterator->second->takeChanges(changes);
+
+	if (forks != NULL)
+	  {
+	    forks->insert(std::make_pair(iterator->first, iterator->second->fork()));
+	    continue;
+	  }
+	if (changes.empty())
+	  continue;
+
+	// days only grow, so each change goes at the end of its shelf's list
+	std::map<std::string, shelf_changes>& shelves = deltas[iterator->first];
+	for (std::size_t i = 0; i < changes.size(); i++)
+	  {
+	    shelf_changes& quantities = shelves[changes[i]];
+	    quantities.insert(quantities.end(), std::make_pair(day, iterator->second->onHand(changes[i])));
+	  }
+      }
+    committed = day + 1;
+  }
+
+  // onHand - the shelf's last delta at or before day, unless the full version the day
+  // belongs to is newer
+  long long inventory_history::onHand(int day, const std::string& house, const std::string& upc_code) const
+  {
+    if (committed == 0 || day < 0)
+      return 0;
+    if (day >= committed)
+      day = committed - 1;
+
+    std::map<int, std::map<std::string, warehouse*> >::const_iterator version = full.upper_bound(day);
+    --version;
+
+    std::map<std::string, std::map<std::string, shelf_changes> >::const_iterator changedHouse = deltas.find(house);
+    if (changedHouse != deltas.end())
+      {
+	std::map<std::string, shelf_changes>::const_iterator changedShelf = changedHouse->second.find(upc_code);
+	if (changedShelf != changedHouse->second.end())
+	  {
+	    shelf_changes::const_iterator change = changedShelf->second.upper_bound(day);
+	    if (change != changedShelf->second.begin() && (--change)->first > version->first)
+	      return change->second;
+	  }
+      }
+
+    std::map<std::string, warehouse*>::const_iterator forked = version->second.find(house);
+    if (forked == version->second.end())
+      return 0;
+    return forked->second->onHand(upc_code);
+  }
+
+  int inventory_history::days() const
+  {
+    return committed;
+  }
+
+  int inventory_history::fullVersions() const
+  {
+    return (int)full.size();
+  }
+}
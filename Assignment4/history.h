@@ -0,0 +1,80 @@
+//--------------------------------------------
+// history.h
+//
+// header for the inventory_history class
+// a history keeps a version of every warehouse's stock for each day of the log, so
+// questions like "how much of UPC X was on hand in Fullerton on day 143" are answered
+// without replaying the log up to that day
+//
+// each "Next day:" commits one version (the state after that day's expiry):
+// - every k-th version is a full one: a fork of each warehouse (warehouse::fork), which
+//   shares all its shelves with the live warehouse and so costs one map copy; the live
+//   warehouse copies a shelf before changing it, so a full version only keeps the shelves
+//   changed after it
+// - the versions in between are deltas: the quantity on hand of just the shelves changed
+//   that day, kept per shelf (warehouse and upc code) in a list by day
+// a query finds the nearest full version at or before its day by binary search, and the
+// shelf's last delta at or before its day by another; a delta after the full version
+// answers it, otherwise the full version does
+// so a query costs O(log n) lookups whatever k is, and k only trades the memory of full
+// versions (the shelves copied after each) against that of the deltas
+//--------------------------------------------
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "warehouse.h"
+
+namespace reports
+{
+  class inventory_history
+  {
+  public:
+    // parameter - every - a full version is kept every this many days (at least 1)
+    explicit inventory_history(int every);
+
+    // Destructor - deletes the warehouse forks of the full versions
+    ~inventory_history();
+
+    // track - starts recording the changes of a warehouse; called for every warehouse
+    // when it is declared, before its first transaction
+    void track(warehouse* house);
+
+    // commit - saves the version of day (days since start) from the tracked warehouses
+    // days must be committed in order, 0, 1, 2 ...
+    void commit(int day, const std::map<std::string, warehouse*>& houses);
+
+    // onHand - returns the quantity of a product on hand in a warehouse at the end of day
+    // a day after the last committed one is answered from the last committed version,
+    // and a warehouse or product never seen holds 0
+    long long onHand(int day, const std::string& house, const std::string& upc_code) const;
+
+    // days - returns the number of committed versions
+    int days() const;
+
+    // fullVersions - returns the number of full versions kept
+    int fullVersions() const;
+
+  private:
+    inventory_history(const inventory_history&);
+    inventory_history& operator=(const inventory_history&);
+
+    // quantities on hand by day, for the days a shelf changed
+    typedef std::map<int, long long> shelf_changes;
+
+    int every;
+    int committed;
+
+    // full versions by day, each a fork of every warehouse by name
+    std::map<int, std::map<std::string, warehouse*> > full;
+
+    // deltas by warehouse and upc code; the days of full versions are not in them
+    std::map<std::string, std::map<std::string, shelf_changes> > deltas;
+  };
+}
+
+#endif
@@ -29,19 +29,75 @@ namespace reports
     this->next = NULL;
 
     // modify constructor calls for auditing purposes
-    node::constructor_calls++;
+    node::constructor_calls.fetch_add(1, std::memory_order_relaxed);
   }
 
   // Destructor, destroys a node and opens of memory
   node::~node()
   {
     // modify destructor calls for auditing purposes
-    node::destructor_calls++;
+    node::destructor_calls.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // spare_list - recycled nodes waiting for reuse, one list per thread so no locking is
+  // needed; at most spare_limit of them, the rest are really deleted when the thread exits
+  struct node::spare_list
+  {
+    node* head;
+    long long count;
+
+    ~spare_list()
+    {
+      while (head != NULL)
+	{
+	  node* temp = head;
+	  head = head->next;
+	  delete temp;
+	}
+    }
+  };
+
+  thread_local node::spare_list node::spares = { NULL, 0 };
+
+  // make - pops a spare node and resets it, or builds a new one
+  node* node::make(int currentDate, int shelfLife)
+  {
+    node* result = spares.head;
+    if (result == NULL)
+      return new node(currentDate, shelfLife);
+
+    spares.head = result->next;
+    spares.count--;
+    result->quantity = 0;
+    result->expireDate = currentDate + shelfLife;
+    result->next = NULL;
+    return result;
+  }
+
+  // recycle - splices the whole chain onto the front of the spare list, or deletes it
+  // node by node if the list has no room for all of it
+  void node::recycle(node* first, node* last, long long count)
+  {
+    if (spares.count + count > spare_limit)
+      {
+	last->next = NULL;
+	while (first != NULL)
+	  {
+	    node* temp = first;
+	    first = first->next;
+	    delete temp;
+	  }
+	return;
+      }
+
+    last->next = spares.head;
+    spares.head = first;
+    spares.count += count;
   }
 
   // Methods and data for auditing purposes, copied from homework 3
-  long long node::constructor_calls = 0;
-  long long node::destructor_calls = 0;
+  std::atomic<long long> node::constructor_calls(0);
+  std::atomic<long long> node::destructor_calls(0);
 
   // Returns value of constructor_calls
   long long node::constructor_count()
@@ -54,4 +110,13 @@ namespace reports
   {
     return node::destructor_calls;
   }
+
+  // Returns the length of this thread's spare list
+  long long node::spare_count()
+  {
+    long long length = 0;
+    for (node* curr = spares.head; curr != NULL; curr = curr->next)
+      length++;
+    return length;
+  }
 }
@@ -18,6 +18,8 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include <atomic>
+
 namespace reports
 {
   class node
@@ -36,6 +38,19 @@ namespace reports
     // Deconstructor, destroys a node and opens up memory
     ~node();
 
+    // make - returns a node as the constructor would build it, reusing one of this
+    // thread's recycled nodes when there is one
+    static node* make(int currentDate, int shelfLife);
+
+    // recycle - hands the chain of count nodes first .. last (linked through next) to this
+    // thread's spare list; constant time however long the chain is, unless the list
+    // would grow past spare_limit, in which case the chain is deleted instead
+    static void recycle(node* first, node* last, long long count);
+
+    // spare_list - per thread list of recycled nodes, deleted when the thread exits
+    struct spare_list;
+    static thread_local spare_list spares;
+
     // Quantity: amount of food stock in the node
     int quantity;
 
@@ -51,9 +66,16 @@ namespace reports
     static long long constructor_count ();
     static long long destructor_count ();
 
+    // spare_count - returns the length of this thread's spare list, counted by walking it
+    static long long spare_count ();
+
+    // the most nodes a thread's spare list keeps (about a megabyte of them), so a large
+    // drain gives its memory back instead of holding it for the life of the thread
+    static const long long spare_limit = 65536;
+
   private:
-    static long long constructor_calls;
-    static long long destructor_calls;
+    static std::atomic<long long> constructor_calls;
+    static std::atomic<long long> destructor_calls;
   };
 }
 
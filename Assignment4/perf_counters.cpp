@@ -0,0 +1,229 @@
+//----------------------------------------------
+// perf_counters.cpp
+//
+// class function definitions for perf_counters
+// a more detailed description can be found in perf_counters.h
+//----------------------------------------------
+
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace reports
+{
+  namespace
+  {
+    // counter - one hardware counter and how it is printed
+    struct counter
+    {
+      const char* name;
+      unsigned type;
+      unsigned long long config;
+    };
+
+#ifdef __linux__
+    const counter counters[5] =
+      {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "L1d misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+	  | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+      };
+
+    // open_counter - opens a counter of this thread in user space, disabled if it leads
+    // a group
+    int open_counter(const counter& which, int group)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = which.type;
+      attr.config = which.config;
+      attr.disabled = group == -1 ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+    }
+#endif
+
+    const char* region_names[region_count] =
+      { "parse", "receiveToShelf", "requestToShelf", "transferToShelf", "advanceDay", "report" };
+  }
+
+  perf_counters::perf_counters()
+    : leader(-1), opened(0), current(region_count)
+  {
+    for (int c = 0; c < counter_count; c++)
+      {
+	descriptors[c] = -1;
+	position[c] = -1;
+	last[c] = 0;
+      }
+    for (int r = 0; r <= region_count; r++)
+      {
+	for (int c = 0; c < counter_count; c++)
+	  totals[r][c] = 0;
+	milliseconds[r] = 0;
+	calls[r] = 0;
+      }
+
+#ifdef __linux__
+    // the first counter that opens leads the group, the others join it
+    for (int c = 0; c < counter_count; c++)
+      {
+	int fd = open_counter(counters[c], leader);
+	if (fd < 0)
+	  {
+	    if (failure.empty())
+	      failure = std::string(counters[c].name) + ": " + std::strerror(errno);
+	    continue;
+	  }
+	descriptors[c] = fd;
+	position[c] = opened++;
+	if (leader == -1)
+	  leader = fd;
+      }
+
+    if (leader != -1 && ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+      {
+	failure = std::string("enable: ") + std::strerror(errno);
+	for (int c = 0; c < counter_count; c++)
+	  if (descriptors[c] != -1)
+	    {
+	      close(descriptors[c]);
+	      descriptors[c] = -1;
+	      position[c] = -1;
+	    }
+	leader = -1;
+	opened = 0;
+      }
+#else
+    failure = "perf_event_open is Linux only";
+#endif
+
+    lastTime = std::chrono::steady_clock::now();
+  }
+
+  perf_counters::~perf_counters()
+  {
+    for (int c = 0; c < counter_count; c++)
+      if (descriptors[c] != -1)
+	close(descriptors[c]);
+  }
+
+  bool perf_counters::available() const
+  {
+    return opened > 0;
+  }
+
+  int perf_counters::enter(perf_region region)
+  {
+    int previous = current;
+    switchTo(region);
+    return previous;
+  }
+
+  void perf_counters::leave(int previous)
+  {
+    switchTo(previous);
+  }
+
+  void perf_counters::count(perf_region region, long long added)
+  {
+    calls[region] += added;
+  }
+
+  // switchTo - a group read returns the number of counters, then each count in the order
+  // the counters joined the group
+  void perf_counters::switchTo(int region)
+  {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    milliseconds[current] += std::chrono::duration<double, std::milli>(now - lastTime).count();
+    lastTime = now;
+
+    if (leader != -1)
+      {
+	unsigned long long values[1 + counter_count];
+	if (read(leader, values, sizeof(values)) >= (ssize_t)((1 + opened) * sizeof(values[0])))
+	  for (int c = 0; c < counter_count; c++)
+	    if (position[c] != -1)
+	      {
+		long long value = (long long)values[1 + position[c]];
+		totals[current][c] += value - last[c];
+		last[c] = value;
+	      }
+      }
+
+    current = region;
+  }
+
+  const char* perf_counters::region_name(int region)
+  {
+    return region_names[region];
+  }
+
+  // printRow - a counter per call, or "-" if it was not counted
+  void perf_counters::printRow(std::ostream& out, const char* name, long long rowCalls, double time,
+			       const long long* sums) const
+  {
+    long long divisor = rowCalls > 0 ? rowCalls : 1;
+    char cells[counter_count][32];
+    for (int c = 0; c < counter_count; c++)
+      {
+	if (position[c] == -1)
+	  std::snprintf(cells[c], sizeof(cells[c]), "-");
+	else
+	  std::snprintf(cells[c], sizeof(cells[c]), "%.1f", (double)sums[c] / divisor);
+      }
+    char ipc[32] = "-";
+    if (position[0] != -1 && position[1] != -1 && sums[0] > 0)
+      std::snprintf(ipc, sizeof(ipc), "%.2f", (double)sums[1] / sums[0]);
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-16s %10lld %10.3f %12s %12s %6s %10s %10s %10s",
+		  name, rowCalls, time, cells[0], cells[1], ipc, cells[2], cells[3], cells[4]);
+    out << line << std::endl;
+  }
+
+  void perf_counters::print(std::ostream& out) const
+  {
+    char line[256];
+    if (!available())
+      out << "hardware counters unavailable (" << failure << "), time only" << std::endl;
+    else if (!failure.empty())
+      out << "some hardware counters unavailable (" << failure << ")" << std::endl;
+
+    std::snprintf(line, sizeof(line), "%-16s %10s %10s %12s %12s %6s %10s %10s %10s",
+		  "per call", "calls", "ms", "cycles", "instructions", "IPC", "L1d miss", "LLC miss", "br miss");
+    out << line << std::endl;
+
+    // the whole run, time outside every region included, for the per transaction line
+    long long transactions = calls[receive_region] + calls[request_region] + calls[transfer_region];
+    long long all[counter_count] = { 0, 0, 0, 0, 0 };
+    double allTime = 0;
+    for (int r = 0; r <= region_count; r++)
+      {
+	for (int c = 0; c < counter_count; c++)
+	  all[c] += totals[r][c];
+	allTime += milliseconds[r];
+      }
+
+    for (int r = 0; r < region_count; r++)
+      if (calls[r] != 0)
+	printRow(out, region_names[r], calls[r], milliseconds[r], totals[r]);
+    printRow(out, "per transaction", transactions, allTime, all);
+  }
+}
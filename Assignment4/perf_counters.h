@@ -0,0 +1,138 @@
+//--------------------------------------------
+// perf_counters.h
+//
+// header for the perf_counters class
+// perf_counters reads the processor's hardware counters (Linux perf_event_open) around
+// named regions of the program, so a change to the shelf or warehouse code can be judged
+// by its cache misses, branch misses and instructions per transaction, not just its time
+//
+// the counters are opened once as a group (read together in one system call):
+// - cycles and instructions
+// - L1 data cache read misses
+// - last level cache misses
+// - branch misses
+// time is always measured; a counter the processor, kernel or container does not allow
+// (perf_event_paranoid, seccomp, virtual machines without a PMU) is left out and printed
+// as "-", and without any counters only the time is printed
+//
+// regions are exclusive: entering a region charges everything counted so far to the
+// region being left, and leaving it charges the region to itself and goes back, so a
+// receive inside the parse of a log is not counted twice
+// every switch between regions costs a system call (about a microsecond), so the counts
+// of very short regions include some of that
+//--------------------------------------------
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace reports
+{
+  enum perf_region
+  {
+    parse_region,
+    receive_region,
+    request_region,
+    transfer_region,
+    advance_region,
+    report_region,
+    region_count
+  };
+
+  class perf_counters
+  {
+  public:
+    // constructor - opens the counters and starts them; failures are remembered, not thrown
+    perf_counters();
+
+    // destructor - closes the counters
+    ~perf_counters();
+
+    // available - returns true if at least one hardware counter could be opened
+    bool available() const;
+
+    // enter - charges what was counted since the last switch and makes region current
+    // returns - the region that was current, for leave
+    int enter(perf_region region);
+
+    // leave - charges what was counted to the current region and makes previous current
+    void leave(int previous);
+
+    // count - adds calls to a region, the divisor for its per call figures
+    void count(perf_region region, long long calls);
+
+    // print - writes one line per region used: calls, time and every counter per call,
+    // then the whole run per transaction (receive, request and transfer calls)
+    void print(std::ostream& out) const;
+
+    // the names regions are printed with
+    static const char* region_name(int region);
+
+  private:
+    perf_counters(const perf_counters&);
+    perf_counters& operator=(const perf_counters&);
+
+    enum
+    {
+      counter_count = 5
+    };
+
+    // switchTo - reads the counters and charges them to the current region
+    void switchTo(int region);
+
+    // printRow - writes one line of print, dividing sums by rowCalls
+    void printRow(std::ostream& out, const char* name, long long rowCalls, double time,
+		  const long long* sums) const;
+
+    // the group leader's descriptor, and each counter's position in the group (-1 if it
+    // could not be opened)
+    int leader;
+    int descriptors[counter_count];
+    int position[counter_count];
+    int opened;
+    std::string failure;
+
+    // the region being counted, region_count before the first enter
+    int current;
+    long long last[counter_count];
+    std::chrono::steady_clock::time_point lastTime;
+
+    // totals by region; the extra slot collects time outside every region
+    long long totals[region_count + 1][counter_count];
+    double milliseconds[region_count + 1];
+    long long calls[region_count + 1];
+  };
+
+  // perf_scope - enters a region for its lifetime; does nothing without counters
+  class perf_scope
+  {
+  public:
+    perf_scope(perf_counters* i_counters, perf_region region, long long calls = 1)
+      : counters(i_counters), previous(0)
+    {
+      if (counters != NULL)
+	{
+	  previous = counters->enter(region);
+	  counters->count(region, calls);
+	}
+    }
+
+    ~perf_scope()
+    {
+      if (counters != NULL)
+	counters->leave(previous);
+    }
+
+  private:
+    perf_scope(const perf_scope&);
+    perf_scope& operator=(const perf_scope&);
+
+    perf_counters* counters;
+    int previous;
+  };
+}
+
+#endif
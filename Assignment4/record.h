@@ -0,0 +1,255 @@
+//--------------------------------------------
+// record.h
+//
+// compile-time descriptions of the transaction log line formats and the parser
+// generated from them
+//
+// every line of a log starts with a three letter prefix ("Foo", "War", "Sta", "Rec",
+// "Req", "Tra", "Nex", "End") which selects the record type, and every record type keeps
+// its fields at fixed offsets, for example
+//   FoodItem - UPC Code: 0353264991  Shelf life: 2  Name: chestnut puree with vanilla
+//   Receive: 0984523912 7 Tacoma
+//   Transfer: 0984523912 3 Tacoma Ann Arbor
+// each record type is described by a small format struct whose template parameters are
+// those offsets, so the compiler folds them into the generated parser
+// the prefix is packed into a single integer and dispatched through one switch
+//
+// a log with different field widths (for example 12 digit UPC codes) only needs a new
+// set of descriptors, see upc12_format at the bottom of this file (fuzz.cpp checks it
+// against 12 digit sample lines)
+//--------------------------------------------
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace reports
+{
+  // prefix - packs the three leading characters of a record into one integer
+  constexpr std::uint32_t prefix(char a, char b, char c)
+  {
+    return std::uint32_t((unsigned char)a)
+      | (std::uint32_t((unsigned char)b) << 8)
+      | (std::uint32_t((unsigned char)c) << 16);
+  }
+
+  // parse_count - reads a decimal integer the way atoi does: leading blanks, an optional
+  // sign and then digits up to the first non digit
+  inline int parse_count(std::string_view text)
+  {
+    std::size_t i = 0;
+    while (i < text.size() && (text[i] == ' ' || (text[i] >= '\t' && text[i] <= '\r')))
+      i++;
+
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+'))
+      {
+	negative = text[i] == '-';
+	i++;
+      }
+
+    // accumulated unsigned so absurdly long fields wrap instead of overflowing
+    unsigned int value = 0;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++)
+      value = value * 10 + (text[i] - '0');
+
+    return (int)(negative ? 0u - value : value);
+  }
+
+  // space_from - returns the index of the first space at or after start, or 0 if there
+  // is none (the log's fields are space delimited after their fixed start)
+  inline std::size_t space_from(std::string_view line, std::size_t start)
+  {
+    for (std::size_t i = start; i < line.size(); i++)
+      if (line[i] == ' ')
+	return i;
+    return 0;
+  }
+
+  // NOTE on the descriptors below: fields are cut with string_view::substr, so a line
+  // too short for a fixed offset throws std::out_of_range just like std::string::substr
+  // did, and lengths computed from the line wrap around the same way (to "rest of line")
+  // Trailer is the number of characters dropped from the end of names (the logs were
+  // written with CRLF line endings)
+
+  // food_format - "FoodItem - UPC Code: <upc>  Shelf life: <days>  Name: <name>"
+  // NameGap is the distance from the space after the shelf life to the name
+  template <std::size_t UpcOffset, std::size_t UpcWidth, std::size_t LifeOffset,
+	    std::size_t NameGap, std::size_t Trailer>
+  struct food_format
+  {
+    static constexpr std::uint32_t tag = prefix('F', 'o', 'o');
+
+    template <class Handler>
+    static void parse(std::string_view line, Handler& handler)
+    {
+      std::string_view upc = line.substr(UpcOffset, UpcWidth);
+      std::size_t space = space_from(line, LifeOffset);
+      int life = parse_count(line.substr(LifeOffset, space - LifeOffset));
+      std::string_view name = line.substr(space + NameGap, line.size() - (space + NameGap) - Trailer);
+
+      handler.foodItem(upc, life, name);
+    }
+  };
+
+  // transaction_format - "<Tag>: <upc> <qty> <warehouse>", used for Receive and Request,
+  // and for Transfer, whose "warehouse" is the two names "<from> <to>" (see split_names)
+  template <char A, char B, char C, std::size_t UpcOffset, std::size_t UpcWidth,
+	    std::size_t QtyOffset, std::size_t Trailer>
+  struct transaction_format
+  {
+    static constexpr std::uint32_t tag = prefix(A, B, C);
+
+    // cut - splits the line into its upc, quantity and warehouse name fields
+    static void cut(std::string_view line, std::string_view& upc, int& qty, std::string_view& name)
+    {
+      upc = line.substr(UpcOffset, UpcWidth);
+      std::size_t space = space_from(line, QtyOffset);
+      qty = parse_count(line.substr(QtyOffset, space - QtyOffset));
+      name = line.substr(space + 1, line.size() - (space + 1) - Trailer);
+    }
+
+    // inner_trim - the characters a name cut from inside the line (the from half of a
+    // Transfer) must lose to read the way a name cut from the end of a line was: Trailer,
+    // less the '\r' line ending Trailer took off this line; 0 in a CRLF log, and in an
+    // LF log Trailer, since there the declared names lost their last characters
+    static std::size_t inner_trim(std::string_view line)
+    {
+      std::size_t trim = Trailer;
+      for (std::size_t i = line.size(); i > 0 && trim > 0 && line[i - 1] == '\r'; i--)
+	trim--;
+      return trim;
+    }
+  };
+
+  // split_names - splits the "<from> <to>" field of a Transfer; warehouse names may hold
+  // spaces themselves, so the split is made at the first space where both sides are
+  // names known is true for
+  // the from half first loses trim characters (see inner_trim) so it matches the name
+  // its Warehouse line declared; from is set to that trimmed name
+  // returns - false if there is no such space
+  template <class Known>
+  inline bool split_names(std::string_view names, std::size_t trim, const Known& known,
+			  std::string_view& from, std::string_view& to)
+  {
+    for (std::size_t i = names.find(' '); i != std::string_view::npos; i = names.find(' ', i + 1))
+      if (i >= trim && known(names.substr(0, i - trim)) && known(names.substr(i + 1)))
+	{
+	  from = names.substr(0, i - trim);
+	  to = names.substr(i + 1);
+	  return true;
+	}
+    return false;
+  }
+
+  // warehouse_format - "Warehouse - <name>"
+  template <std::size_t NameOffset, std::size_t Trailer>
+  struct warehouse_format
+  {
+    static constexpr std::uint32_t tag = prefix('W', 'a', 'r');
+    static constexpr std::size_t trailer = Trailer;
+
+    template <class Handler>
+    static void parse(std::string_view line, Handler& handler)
+    {
+      handler.warehouse(line.substr(NameOffset, line.size() - NameOffset - Trailer));
+    }
+  };
+
+  // start_format - "Start date: MM/DD/YYYY"
+  template <std::size_t MonthOffset, std::size_t DayOffset, std::size_t YearOffset>
+  struct start_format
+  {
+    static constexpr std::uint32_t tag = prefix('S', 't', 'a');
+
+    template <class Handler>
+    static void parse(std::string_view line, Handler& handler)
+    {
+      handler.start(line.substr(MonthOffset, 2), line.substr(DayOffset, 2), line.substr(YearOffset, 4));
+    }
+  };
+
+  // log_format - bundles one descriptor per record type
+  template <class Food, class Warehouse, class Start, class Receive, class Request, class Transfer>
+  struct log_format
+  {
+    typedef Food food;
+    typedef Warehouse warehouse;
+    typedef Start start;
+    typedef Receive receive;
+    typedef Request request;
+    typedef Transfer transfer;
+
+    static constexpr std::uint32_t next = prefix('N', 'e', 'x');
+    static constexpr std::uint32_t end = prefix('E', 'n', 'd');
+  };
+
+  // parse_record - dispatches one line to the handler
+  // the handler provides foodItem(upc, life, name), warehouse(name), start(month, day, year),
+  // receive(upc, qty, name), request(upc, qty, name), transfer(upc, qty, names, trim) and
+  // nextDay(); trim is what split_names needs to cut names
+  // returns - false once the End record is reached, true otherwise
+  template <class Format, class Handler>
+  inline bool parse_record(std::string_view line, Handler& handler)
+  {
+    // lines shorter than a prefix (blank lines) carry no record
+    if (line.size() < 3)
+      return true;
+
+    std::string_view upc;
+    std::string_view name;
+    int qty;
+
+    switch (prefix(line[0], line[1], line[2]))
+      {
+      case Format::food::tag:
+	Format::food::parse(line, handler);
+	break;
+      case Format::warehouse::tag:
+	Format::warehouse::parse(line, handler);
+	break;
+      case Format::start::tag:
+	Format::start::parse(line, handler);
+	break;
+      case Format::receive::tag:
+	Format::receive::cut(line, upc, qty, name);
+	handler.receive(upc, qty, name);
+	break;
+      case Format::request::tag:
+	Format::request::cut(line, upc, qty, name);
+	handler.request(upc, qty, name);
+	break;
+      case Format::transfer::tag:
+	Format::transfer::cut(line, upc, qty, name);
+	handler.transfer(upc, qty, name, Format::transfer::inner_trim(line));
+	break;
+      case Format::next:
+	handler.nextDay();
+	break;
+      case Format::end:
+	return false;
+      }
+    return true;
+  }
+
+  // standard_format - the 10 digit UPC logs produced by GenerateFakeData
+  typedef log_format<food_format<21, 10, 45, 8, 1>,
+		     warehouse_format<12, 1>,
+		     start_format<12, 15, 18>,
+		     transaction_format<'R', 'e', 'c', 9, 10, 20, 1>,
+		     transaction_format<'R', 'e', 'q', 9, 10, 20, 1>,
+		     transaction_format<'T', 'r', 'a', 10, 10, 21, 1> > standard_format;
+
+  // upc12_format - the same logs with 12 digit UPC-A codes, every later field shifts by 2
+  typedef log_format<food_format<21, 12, 47, 8, 1>,
+		     warehouse_format<12, 1>,
+		     start_format<12, 15, 18>,
+		     transaction_format<'R', 'e', 'c', 9, 12, 22, 1>,
+		     transaction_format<'R', 'e', 'q', 9, 12, 22, 1>,
+		     transaction_format<'T', 'r', 'a', 10, 12, 23, 1> > upc12_format;
+}
+
+#endif
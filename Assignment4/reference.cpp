@@ -0,0 +1,293 @@
+//----------------------------------------------
+// reference.cpp
+//
+// definitions for the reference models in reference.h
+//----------------------------------------------
+
+#include "reference.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+namespace reports
+{
+  reference_warehouse::reference_warehouse()
+    : busiestDay(0), highestTransactionsToDate(0), currentDayTransactions(0), shortfall(0)
+  {
+  }
+
+  // add_lot - adds a lot to the lot with its expiration date, or inserts it in order
+  static void add_lot(std::deque<std::pair<int, int> >& lots, int expireDate, int qty)
+  {
+    std::deque<std::pair<int, int> >::iterator at = lots.begin();
+    while (at != lots.end() && at->first < expireDate)
+      ++at;
+    if (at != lots.end() && at->first == expireDate)
+      at->second += qty;
+    else
+      lots.insert(at, std::make_pair(expireDate, qty));
+  }
+
+  // receiveToShelf - shelf::receive: a lot expiring currentDate + the shelf's shelf life
+  void reference_warehouse::receiveToShelf(const std::string& upc_code, int qty, int currentDate, int shelfLife)
+  {
+    std::map<std::string, shelf>::iterator found = shelves.find(upc_code);
+    if (found == shelves.end())
+      {
+	shelf fresh;
+	fresh.shelfLife = shelfLife;
+	found = shelves.insert(std::make_pair(upc_code, fresh)).first;
+      }
+
+    shelf& curr = found->second;
+    add_lot(curr.lots, currentDate + curr.shelfLife, qty);
+
+    currentDayTransactions += qty;
+  }
+
+  // requestToShelf - shelf::request: take from the oldest lots, dropping emptied ones
+  void reference_warehouse::requestToShelf(const std::string& upc_code, int qty)
+  {
+    currentDayTransactions += qty;
+    if (qty > 0)
+      requestedTotals[upc_code] += qty;
+
+    std::map<std::string, shelf>::iterator found = shelves.find(upc_code);
+    if (found == shelves.end())
+      {
+	shortfall += qty;
+	return;
+      }
+
+    std::deque<std::pair<int, int> >& lots = found->second.lots;
+    int remain = qty;
+    while (!lots.empty())
+      {
+	int take = remain > lots.front().second ? lots.front().second : remain;
+	remain -= take;
+	lots.front().second -= take;
+	if (lots.front().second != 0)
+	  break;
+	lots.pop_front();
+      }
+    shortfall += remain;
+
+    if (lots.empty())
+      shelves.erase(found);
+  }
+
+  // transferToShelf - request's loop at the source, add_lot at the destination
+  int reference_warehouse::transferToShelf(const std::string& upc_code, int qty, reference_warehouse& destination)
+  {
+    if (&destination == this || qty <= 0)
+      return 0;
+    currentDayTransactions += qty;
+
+    std::map<std::string, shelf>::iterator found = shelves.find(upc_code);
+    if (found == shelves.end())
+      return 0;
+
+    std::deque<std::pair<int, int> > moved;
+    std::deque<std::pair<int, int> >& lots = found->second.lots;
+    int remain = qty;
+    while (!lots.empty() && remain > 0)
+      {
+	int take = remain > lots.front().second ? lots.front().second : remain;
+	remain -= take;
+	moved.push_back(std::make_pair(lots.front().first, take));
+	lots.front().second -= take;
+	if (lots.front().second == 0)
+	  lots.pop_front();
+      }
+
+    std::map<std::string, shelf>::iterator receiving = destination.shelves.find(upc_code);
+    if (receiving == destination.shelves.end())
+      {
+	shelf fresh;
+	fresh.shelfLife = found->second.shelfLife;
+	receiving = destination.shelves.insert(std::make_pair(upc_code, fresh)).first;
+      }
+    for (std::size_t i = 0; i < moved.size(); i++)
+      add_lot(receiving->second.lots, moved[i].first, moved[i].second);
+    destination.currentDayTransactions += qty - remain;
+
+    if (lots.empty())
+      shelves.erase(found);
+    if (receiving->second.lots.empty())
+      destination.shelves.erase(receiving);
+    return qty - remain;
+  }
+
+  // advanceDay - drops at most the head lot of each shelf, and the shelves left empty,
+  // then updates the busiest day
+  void reference_warehouse::advanceDay(int dayVal)
+  {
+    for (std::map<std::string, shelf>::iterator iterator = shelves.begin(); iterator != shelves.end(); )
+      {
+	std::deque<std::pair<int, int> >& lots = iterator->second.lots;
+	if (!lots.empty() && lots.front().first == dayVal)
+	  {
+	    if (lots.front().second > 0)
+	      expiredTotals[iterator->first] += lots.front().second;
+	    lots.pop_front();
+	  }
+	if (lots.empty())
+	  iterator = shelves.erase(iterator);
+	else
+	  ++iterator;
+      }
+
+    if (currentDayTransactions >= highestTransactionsToDate)
+      {
+	busiestDay = dayVal;
+	highestTransactionsToDate = currentDayTransactions;
+      }
+    currentDayTransactions = 0;
+  }
+
+  bool reference_warehouse::isStocked(const std::string& upc_code) const
+  {
+    std::map<std::string, shelf>::const_iterator found = shelves.find(upc_code);
+    return found != shelves.end() && !found->second.lots.empty();
+  }
+
+  // onHand - sums the lots
+  long long reference_warehouse::onHand(const std::string& upc_code) const
+  {
+    std::map<std::string, shelf>::const_iterator found = shelves.find(upc_code);
+    if (found == shelves.end())
+      return 0;
+    long long total = 0;
+    for (std::size_t i = 0; i < found->second.lots.size(); i++)
+      total += found->second.lots[i].second;
+    return total;
+  }
+
+  long long reference_warehouse::getShortfall() const
+  {
+    return shortfall;
+  }
+
+  int reference_warehouse::getBusiestDay() const
+  {
+    return busiestDay;
+  }
+
+  int reference_warehouse::getHighestTransactions() const
+  {
+    return highestTransactionsToDate;
+  }
+
+  int reference_warehouse::getCurrentTransactions() const
+  {
+    return currentDayTransactions;
+  }
+
+  // sorted_totals - the totals above 0, largest first
+  static void sorted_totals(const std::map<std::string, long long>& totals,
+			    std::vector<std::pair<std::string, long long> >& out)
+  {
+    for (std::map<std::string, long long>::const_iterator iterator = totals.begin(); iterator != totals.end(); ++iterator)
+      out.push_back(*iterator);
+    std::stable_sort(out.begin(), out.end(),
+		     [](const std::pair<std::string, long long>& a, const std::pair<std::string, long long>& b)
+		     {
+		       return a.second > b.second;
+		     });
+  }
+
+  void reference_warehouse::topLists(std::vector<std::pair<std::string, long long> >& requested,
+				     std::vector<std::pair<std::string, long long> >& expired) const
+  {
+    sorted_totals(requestedTotals, requested);
+    sorted_totals(expiredTotals, expired);
+  }
+
+  void reference_warehouse::contents(std::map<std::string, std::vector<std::pair<int, int> > >& out) const
+  {
+    for (std::map<std::string, shelf>::const_iterator iterator = shelves.begin(); iterator != shelves.end(); ++iterator)
+      if (!iterator->second.lots.empty())
+	out[iterator->first].assign(iterator->second.lots.begin(), iterator->second.lots.end());
+  }
+
+  // reference_parse - the substr arithmetic from the original report.cpp main loop
+  void reference_parse(const std::string& line, reference_record& record)
+  {
+    record = reference_record();
+    record.number = 0;
+    record.trim = 0;
+
+    std::string id = line.substr(0, 3);
+
+    if (id == "Foo")
+      {
+	record.kind = id;
+	record.upc = line.substr(21, 10);
+	int indexOfWhiteSpace = 0;
+	for (int i = 45; i < (int)line.length(); i++)
+	  {
+	    if (line[i] == ' ')
+	      {
+		indexOfWhiteSpace = i;
+		break;
+	      }
+	  }
+	record.number = atoi(line.substr(45, indexOfWhiteSpace - 45).c_str());
+	int sizeOfName = line.length() - (indexOfWhiteSpace + 8) - 1;
+	record.name = line.substr(indexOfWhiteSpace + 8, sizeOfName);
+      }
+    else if (id == "War")
+      {
+	record.kind = id;
+	record.name = line.substr(12, line.length() - 13);
+      }
+    else if (id == "Sta")
+      {
+	record.kind = id;
+	record.month = line.substr(12, 2);
+	record.day = line.substr(15, 2);
+	record.year = line.substr(18, 4);
+      }
+    else if (id == "Rec" || id == "Req")
+      {
+	record.kind = id;
+	record.upc = line.substr(9, 10);
+	int indexOfWhiteSpace = 0;
+	for (int i = 20; i < (int)line.length(); i++)
+	  {
+	    if (line[i] == ' ')
+	      {
+		indexOfWhiteSpace = i;
+		break;
+	      }
+	  }
+	record.number = atoi(line.substr(20, indexOfWhiteSpace - 20).c_str());
+	int nameLength = line.length() - (indexOfWhiteSpace + 2);
+	record.name = line.substr(indexOfWhiteSpace + 1, nameLength);
+      }
+    // Transfer postdates the original parser; it is cut the same way, one column further on
+    else if (id == "Tra")
+      {
+	record.kind = id;
+	record.upc = line.substr(10, 10);
+	int indexOfWhiteSpace = 0;
+	for (int i = 21; i < (int)line.length(); i++)
+	  {
+	    if (line[i] == ' ')
+	      {
+		indexOfWhiteSpace = i;
+		break;
+	      }
+	  }
+	record.number = atoi(line.substr(21, indexOfWhiteSpace - 21).c_str());
+	int nameLength = line.length() - (indexOfWhiteSpace + 2);
+	record.name = line.substr(indexOfWhiteSpace + 1, nameLength);
+	// the last character is a '\r' in a CRLF log, the end of the to name in an LF one
+	record.trim = line[line.length() - 1] == '\r' ? 0 : 1;
+      }
+    else if (id == "Nex" || id == "End")
+      {
+	record.kind = id;
+      }
+  }
+}
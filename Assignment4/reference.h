@@ -0,0 +1,110 @@
+//--------------------------------------------
+// reference.h
+//
+// reference models used by the differential fuzzer (fuzz.cpp)
+//
+// reference_warehouse restates the inventory rules of warehouse/shelf/node as plainly as
+// possible, with a deque of lots per product instead of a hand managed linked list
+// it deliberately keeps every quirk of the real classes:
+// - a receive is merged into the lot with the same expiration date if there is one,
+//   otherwise it becomes a lot of its own in expiration date order (without transfers
+//   that is: merged into the tail lot if it was received the same day, else appended)
+// - a transfer takes lots from the source the way a request does and merges them into
+//   the destination by expiration date, creating its shelf with the source's shelf life;
+//   it counts the quantity asked for at the source and the quantity moved at the
+//   destination, and does nothing between a warehouse and itself or for qty <= 0
+// - a shelf keeps the shelf life it was created with
+// - advanceDay removes at most the head lot of each shelf, and only when its expiration
+//   date equals the day exactly
+// - a request, transfer or expiry which empties a shelf removes the shelf (so the next
+//   receive creates it again, with that receive's shelf life)
+// - transactions count requested quantities even for products not on the shelf
+// - the part of a request the shelf could not fill counts towards the shortfall
+// - topLists gives the exact requested and expired totals of every product, in the order
+//   heavy_hitters::top lists its estimates (sketch.h)
+//
+// reference_parse is the line parsing report.cpp did before record.h, kept word for
+// word on std::string so the generated parser can be compared against it (with Transfer
+// lines, added later, cut in the same style)
+//--------------------------------------------
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace reports
+{
+  class reference_warehouse
+  {
+  public:
+    reference_warehouse();
+
+    void receiveToShelf(const std::string& upc_code, int qty, int currentDate, int shelfLife);
+    void requestToShelf(const std::string& upc_code, int qty);
+    int transferToShelf(const std::string& upc_code, int qty, reference_warehouse& destination);
+    void advanceDay(int dayVal);
+    bool isStocked(const std::string& upc_code) const;
+    long long onHand(const std::string& upc_code) const;
+    long long getShortfall() const;
+
+    int getBusiestDay() const;
+    int getHighestTransactions() const;
+    int getCurrentTransactions() const;
+
+    // contents - same layout as warehouse::contents
+    void contents(std::map<std::string, std::vector<std::pair<int, int> > >& out) const;
+
+    // topLists - every product with a requested (or expired) quantity above 0 and its
+    // total, largest first, equal totals in UPC order
+    void topLists(std::vector<std::pair<std::string, long long> >& requested,
+		  std::vector<std::pair<std::string, long long> >& expired) const;
+
+  private:
+    // a shelf is its shelf life and its lots as (expireDate, quantity), oldest first
+    struct shelf
+    {
+      int shelfLife;
+      std::deque<std::pair<int, int> > lots;
+    };
+
+    std::map<std::string, shelf> shelves;
+    int busiestDay;
+    int highestTransactionsToDate;
+    int currentDayTransactions;
+    long long shortfall;
+
+    // requested and expired quantities by upc code
+    std::map<std::string, long long> requestedTotals;
+    std::map<std::string, long long> expiredTotals;
+  };
+
+  // reference_record - the fields report.cpp used to cut out of one line
+  struct reference_record
+  {
+    // the three letter prefix if it named a record type, otherwise empty
+    std::string kind;
+
+    std::string upc;
+    std::string name;
+    int number;
+
+    // for a Transfer, the characters the from name drops (see inner_trim in record.h)
+    int trim;
+
+    // start date fields
+    std::string month;
+    std::string day;
+    std::string year;
+  };
+
+  // reference_parse - fills record from line
+  // throws - std::out_of_range where the old substr calls threw
+  void reference_parse(const std::string& line, reference_record& record);
+}
+
+#endif
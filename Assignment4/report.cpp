@@ -20,280 +20,709 @@
 // products that are fully stocked, and each warehouse's busiest day
 //--------------------------------------------
 
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <map>
+#include <string_view>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #include <stdlib.h>
 
-#include "boost/date_time/gregorian/gregorian.hpp"
-
 #include "warehouse.h"
 #include "shelf.h"
 #include "node.h"
+#include "record.h"
+#include "date.h"
+#include "block_reader.h"
+#include "report_writer.h"
+#include "shard.h"
+#include "catalog.h"
+#include "history.h"
+#include "report_format.h"
+#include "perf_counters.h"
+#include "sketch.h"
 
-//Food struct that contains name and shelf life. 
-struct food
+// log_reader - receives the records cut out of each line by reports::parse_record
+// and applies them to the food index and warehouse map
+struct log_reader
 {
-  int shelfLife;
-  std::string name;
-  food(std::string i_name, int i_shelfLife)
+  // start date as days since 1970-01-01 (see date.h), combined the old way for the text
+  // report and as the Start line gives it for the other formats, see start
+  int startDate;
+  int actualStartDate;
+  int daysSinceStart;
+
+  std::map<std::string, reports::warehouse*> warehouseMap;
+  // food catalog: UPC code, shelf life and name, frozen at the first lookup (catalog.h)
+  reports::food_catalog foodIndex;
+
+  // what-if changes made by a scenario, see run_scenarios
+  // shelf lives replacing the catalog's, and warehouses whose transactions are dropped
+  std::map<std::string, int> shelfLifeOverride;
+  std::set<std::string> offline;
+
+  // if set, every next day commits a version of the warehouses to it (see history.h)
+  // not owned by the reader, and not carried over by fork
+  reports::inventory_history* history;
+
+  // if set, the warehouse calls are counted in their regions (see perf_counters.h)
+  // not owned by the reader, and not carried over by fork
+  reports::perf_counters* counters;
+
+  // if set, every warehouse keeps top requested and expired sketches of this size (see
+  // sketch.h); not owned by the reader
+  const reports::sketch_config* topConfig;
+
+  // number (from 1) of the log line being applied; in a shard log, of the original log
+  long long lineNumber;
+
+  // if set, diagnostics are kept here by line number rather than printed (see
+  // shard_result::messages); not owned by the reader
+  std::map<long long, std::vector<std::string> >* messages;
+
+  log_reader() : startDate(0), actualStartDate(0), daysSinceStart(0), history(NULL), counters(NULL), topConfig(NULL),
+		 lineNumber(0), messages(NULL)
   {
-    shelfLife = i_shelfLife;
-    name = i_name;
   }
-};
 
-int main(int argc, char* argv[])
-{
-  //termninates if the argument length isn't 1
-  if(argc != 2)
+  // diagnose - prints what went wrong with the current line, or keeps it
+  void diagnose(const char* what, const char* caught)
+  {
+    if (messages == NULL)
+      {
+	std::cout << what << std::endl;
+	std::cout << caught << std::endl;
+	return;
+      }
+    std::vector<std::string>& lines = (*messages)[lineNumber];
+    lines.push_back(what);
+    lines.push_back(caught);
+  }
+
+  // fork - returns a reader in the same state which can carry on independently
+  // the warehouses are forked copy on write (see warehouse::fork), so the shelves are
+  // shared until one side changes them
+  log_reader* fork() const
+  {
+    log_reader* result = new log_reader();
+    result->startDate = startDate;
+    result->actualStartDate = actualStartDate;
+    result->daysSinceStart = daysSinceStart;
+    result->foodIndex = foodIndex;
+    result->shelfLifeOverride = shelfLifeOverride;
+    result->offline = offline;
+
+    typedef std::map<std::string, reports::warehouse*>::const_iterator walkThrough;
+    for(walkThrough iterator = warehouseMap.begin(); iterator != warehouseMap.end(); ++iterator)
+      {
+	result->warehouseMap.insert(std::make_pair(iterator->first, iterator->second->fork()));
+      }
+    return result;
+  }
+
+  //--- Clear memory ---//
+  ~log_reader()
+  {
+    typedef std::map<std::string, reports::warehouse*>::iterator walkThrough;
+    for(walkThrough iterator = warehouseMap.begin(); iterator != warehouseMap.end(); ++iterator)
+      {
+	delete iterator->second;
+      }
+    warehouseMap.clear();
+  }
+
+  // It's food
+  void foodItem(std::string_view upc, int life, std::string_view name)
+  {
+    foodIndex.add(upc, life, name);
+  }
+
+  // It's a warehouse
+  void warehouse(std::string_view name)
+  {
+    std::string wName(name);
+    if (warehouseMap.find(wName) == warehouseMap.end())
+      {
+	reports::warehouse *houseToInsert = new reports::warehouse();
+	warehouseMap.insert(std::pair<std::string, reports::warehouse*>(wName, houseToInsert));
+	if (history != NULL)
+	  history->track(houseToInsert);
+	if (topConfig != NULL)
+	  houseToInsert->trackHeavyHitters(*topConfig);
+      }
+  }
+
+  // It's the start date
+  // startDate combines the fields the way the earlier from_undelimited_string(year + day +
+  // year) call combined them (day field as the month, leading digits of the year as the
+  // day) so text reports stay identical to those produced before; actualStartDate is the
+  // month, day and year of the line, for the machine readable formats
+  // a line only the old combination accepts keeps printing the old date everywhere rather
+  // than a new diagnostic
+  void start(std::string_view month, std::string_view day, std::string_view year)
+  {
+    startDate = reports::make_date(reports::parse_count(year), reports::parse_count(day),
+				   reports::parse_count(year.substr(0, 2)));
+    try
+      {
+	actualStartDate = reports::make_date(reports::parse_count(year), reports::parse_count(month),
+					     reports::parse_count(day));
+      }
+    catch (std::out_of_range&)
+      {
+	actualStartDate = startDate;
+      }
+  }
+
+  // It's receive
+  void receive(std::string_view upc, int qty, std::string_view name)
+  {
+    if (!offline.empty() && offline.count(std::string(name)) != 0)
+      return;
+
+    std::string upcCode(upc);
+    //checks if food's name already exists
+    try
+      {
+	// an undeclared product is reported the way the old map::at lookup reported it
+	int foodId = foodIndex.find(upc);
+	if (foodId < 0)
+	  throw std::out_of_range("map::at");
+	reports::warehouse* curr = warehouseMap.at(std::string(name));
+
+	int shelfLife = foodIndex.shelfLife(foodId);
+	if (!shelfLifeOverride.empty())
+	  {
+	    std::map<std::string, int>::const_iterator found = shelfLifeOverride.find(upcCode);
+	    if (found != shelfLifeOverride.end())
+	      shelfLife = found->second;
+	  }
+	reports::perf_scope timed(counters, reports::receive_region);
+	curr->receiveToShelf(upcCode, qty, daysSinceStart, shelfLife);
+      }
+    catch (std::exception& e)
+      {
+	diagnose(e.what(), "caught something in receive. ");
+      }
+  }
+
+  // It's request
+  void request(std::string_view upc, int qty, std::string_view name)
+  {
+    if (!offline.empty() && offline.count(std::string(name)) != 0)
+      return;
+
+    try
+      {
+	reports::warehouse* curr = warehouseMap.at(std::string(name));
+	reports::perf_scope timed(counters, reports::request_region);
+	curr->requestToShelf(std::string(upc), qty);
+      }
+    catch (std::exception& e)
+      {
+	diagnose(e.what(), "caught something in request. ");
+      }
+  }
+
+  // It's a transfer
+  void transfer(std::string_view upc, int qty, std::string_view names, std::size_t trim)
+  {
+    try
+      {
+	// the names are split where both halves are warehouses; failing that, the transfer
+	// is reported the way an unknown warehouse is
+	std::string_view from;
+	std::string_view to;
+	const std::map<std::string, reports::warehouse*>& houses = warehouseMap;
+	if (!reports::split_names(names, trim, [&houses](std::string_view name) { return houses.count(std::string(name)) != 0; }, from, to))
+	  throw std::out_of_range("map::at");
+
+	std::string fromName(from);
+	std::string toName(to);
+	if (!offline.empty() && (offline.count(fromName) != 0 || offline.count(toName) != 0))
+	  return;
+	reports::warehouse* fromHouse = warehouseMap.at(fromName);
+	reports::warehouse* toHouse = warehouseMap.at(toName);
+	reports::perf_scope timed(counters, reports::transfer_region);
+	fromHouse->transferToShelf(std::string(upc), qty, *toHouse);
+      }
+    catch (std::exception& e)
+      {
+	diagnose(e.what(), "caught something in transfer. ");
+      }
+  }
+
+  // It's next day
+  void nextDay()
+  {
+    //goes through each warehouse and increments the day.
     {
-      std::cout << "Terminates due to wrong #s of arguments being passed, please try again and only pass 1 text file." << std::endl;
-      return 0;
+      reports::perf_scope timed(counters, reports::advance_region);
+      typedef std::map<std::string, reports::warehouse*>::iterator walkThrough;
+      for(walkThrough iterator = warehouseMap.begin(); iterator != warehouseMap.end(); ++iterator)
+	{
+	  reports::warehouse *curr = iterator->second;
+	  curr->advanceDay(daysSinceStart);
+	}
     }
-  else
+    if (history != NULL)
+      history->commit(daysSinceStart, warehouseMap);
+    daysSinceStart++;
+  }
+};
+
+// read_log - reads every record of the log into the reader
+// parameter - rest - if given, reading stops once the reader has passed stopDay "Next day"
+// lines, and the remaining lines are saved in rest instead
+static void read_log(const std::string& fileName, log_reader& reader,
+		     int stopDay = 0, std::vector<std::string>* rest = NULL)
+{
+  // the whole read is the parse region, less the warehouse calls made from it; its calls
+  // are the lines read
+  reports::perf_scope timed(reader.counters, reports::parse_region, 0);
+  try
     {
-      //using boost::gregorian date library
-      boost::gregorian::date startDate;
-      
-      std::string fileName = argv[1];
-      int daysSinceStart = 0;
-
-      std::map<std::string, reports::warehouse*>* warehouseMap;
-      std::map<std::string, food> foodIndex;
-
-      warehouseMap = new std::map<std::string, reports::warehouse*>();
-      foodIndex = std::map<std::string, food>();
-      //
-
-      std::string pFood = "Foo";
-      std::string pWarehouse = "War";
-      std::string pStart = "Sta";
-      std::string pReceive = "Rec";
-      std::string pRequest = "Req";
-      std::string pNext = "Nex";
-      std::string pEnd = "End";
-      try
+      //start reading file. blocks are read ahead in the background, see block_reader.h
+      reports::block_reader readFile(fileName);
+      std::string_view line;
+      while(readFile.getline(line))
 	{
-	  //start reading file. 
-	  std::ifstream readFile;
-	  readFile.open(fileName.c_str());
-	  std::string line;
-	  while(std::getline(readFile, line))
-	    {	      
-	      std::string id = line.substr(0, 3);
-
-	      // If it's food
-	      if(id == pFood)
-		{
-		  std::string upcCode = line.substr(21, 10);
-		  int indexOfWhiteSpace = 0;
-	 	  //trace to the whitespace
-		  for(int i = 45; i < line.length(); i++)
-		    {
-		      if(line[i] == ' ')
-			{
-			  indexOfWhiteSpace = i;
-			  break;
-			}
-		    }
-		  int life = atoi(line.substr(45, indexOfWhiteSpace - 45).c_str());
-		  int sizeOfName = line.length() - (indexOfWhiteSpace + 8) - 1;
-		  std::string foodName = line.substr(indexOfWhiteSpace + 8, sizeOfName);
-		  
-		  food foodToInsert = food(foodName, life);
-
-		  foodIndex.insert(std::pair<std::string, food>(upcCode, foodToInsert));
-		  
-		}
-	      
-	      // It's a warehouse
-	      else if(id == pWarehouse)
-		{
-		  std::string wName = line.substr(12, line.length() - 13);
-		  if (warehouseMap->find(wName) == warehouseMap->end())
-		    {
-       		      reports::warehouse *houseToInsert = new reports::warehouse();
-		      warehouseMap->insert(std::pair<std::string, reports::warehouse*>(wName, houseToInsert));
-		    }
-		}
-		
-	      // It's the start date
-	      else if (id == pStart)
-	        {
-		  std::string month = line.substr(12, 2);
-		  std::string day = line.substr(15, 2);
-		  std::string year = line.substr(18, 4);
-
-		  std::string dateString = year+day+year;
-
-		  startDate = boost::gregorian::date(boost::gregorian::from_undelimited_string(dateString));
-		}
-
-	      // It's receive
-	      else if (id == pReceive)
-		{
-		  std::string upcCode = line.substr(9, 10);
-		  int indexOfWhiteSpace = 0;
-		  for(int i = 20; i < line.length(); i++)
-		    {
-		      if(line[i] == ' ')
-			{
-			  indexOfWhiteSpace = i;
-			  break;
-			}
-		    }
-		  
-		  int qty = atoi(line.substr(20, indexOfWhiteSpace - 20).c_str());
-		  int nameLength = line.length() - (indexOfWhiteSpace + 2) ;
-		  std::string name = line.substr(indexOfWhiteSpace + 1, nameLength);
-		  //checks if food's name already exists
-		  try 
-		    {
-		      food foodLookup = foodIndex.at(upcCode);
-		      reports::warehouse* curr = warehouseMap->at(name);
-		      curr->receiveToShelf(upcCode, qty, daysSinceStart, foodLookup.shelfLife);
-		    }
-		  catch (std::exception& e)
-		    {
-		      std::cout << e.what() << std::endl;
-		      std::cout << "caught something in receive. " << std::endl;
-		    }
-		}
-
-	      // It's request
-	      else if (id == pRequest)
-		{
-		  std::string upcCode = line.substr(9, 10);
-		  int indexOfWhiteSpace = 0;
-		  for(int i = 20; i < line.length(); i++)
-		    {
-		      if(line[i] == ' ')
-			{
-			  indexOfWhiteSpace = i;
-			  break;
-			}
-		    }
-
-		  int qty = atoi(line.substr(20, indexOfWhiteSpace - 20).c_str());
-		  int nameLength = line.length() - (indexOfWhiteSpace + 2);
-		  std::string name = line.substr(indexOfWhiteSpace + 1, nameLength);
-
-		  try 
-		    {
-		      reports::warehouse* curr = warehouseMap->at(name);
-		      curr->requestToShelf(upcCode, qty);
-		    }
-		  catch (std::exception& e)
-		    {
-		      std::cout << e.what() << std::endl;
-		      std::cout << "caught something in request. " << std::endl;
-		    }
-		}
-
-	      // It's next day
-	      else if (id == pNext)
-		{
-		  //goes through each warehouse and increments the day. 
-		  typedef std::map<std::string, reports::warehouse*>::iterator walkThrough;
-		  for(walkThrough iterator = warehouseMap->begin(); iterator != warehouseMap->end(); ++iterator)
-		    {
-		      reports::warehouse *curr = iterator->second;
-		      curr->advanceDay(daysSinceStart);
-		    }
-		  daysSinceStart++;
-		}
-
-	      // It's the end
-	      else if (id == pEnd)
-		{
-		  readFile.close();
-		  break;
-		}
+	  if (reader.counters != NULL)
+	    reader.counters->count(reports::parse_region, 1);
 
-	    }
-	}
-      catch (std::exception& e)
-	{
-	  std::cout << e.what() << std::endl;
-	  std::cout << "caught exceptions when trying to read data. " << std::endl;
-	}
-      typedef std::map<std::string, reports::warehouse*>::iterator walkThrough;
-      typedef std::map<std::string, food>::iterator foodWalk;
-
-      // Now generate the report
-      std::cout << "Report by Colin & Minwen" << std::endl;
-      std::cout << std::endl;
-      //iterates through for unStocked and fully-stocked items.
-      std::cout << "Unstocked Products:" << std::endl;
-      for(foodWalk fIterator = foodIndex.begin(); fIterator != foodIndex.end(); ++fIterator)
-	{
-	  bool isStocked = true;
-	  for(walkThrough iterator = warehouseMap->begin(); iterator != warehouseMap->end(); ++iterator)
+	  // a shard log gives the original numbers of its lines, see shard.h
+	  reader.lineNumber++;
+	  long long number;
+	  if (reports::line_marker(line, number))
 	    {
-	      reports::warehouse* curr = iterator->second;
-	      isStocked = curr->isStocked(fIterator->first);
-
-	      if (isStocked) break;
+	      reader.lineNumber = number - 1;
+	      continue;
 	    }
-	  if (!isStocked)
+	  if (rest != NULL && reader.daysSinceStart >= stopDay)
 	    {
-	      std::cout << fIterator->first << " " << fIterator->second.name << std::endl;
+	      rest->push_back(std::string(line));
+	      continue;
 	    }
+
+	  // the record format is fixed at compile time, see record.h
+	  if (!reports::parse_record<reports::standard_format>(line, reader))
+	    break;
 	}
+    }
+  catch (std::exception& e)
+    {
+      reader.diagnose(e.what(), "caught exceptions when trying to read data. ");
+    }
+}
+
+// replay - applies saved log lines to the reader, with read_log's error handling
+static void replay(const std::vector<std::string>& lines, log_reader& reader)
+{
+  try
+    {
+      for (std::size_t i = 0; i < lines.size(); i++)
+	if (!reports::parse_record<reports::standard_format>(lines[i], reader))
+	  break;
+    }
+  catch (std::exception& e)
+    {
+      reader.diagnose(e.what(), "caught exceptions when trying to read data. ");
+    }
+}
 
-      std::cout << std::endl;
-      std::cout << "Fully-Stocked Products: " << std::endl;
-      for(foodWalk fIterator = foodIndex.begin(); fIterator != foodIndex.end(); ++fIterator)
+// summarize - collects what the report needs from the reader
+// only warehouses owned by shard index of count are counted, see shard.h; a single
+// process run is shard 0 of 1 and owns every warehouse
+// the reader is not const since a catalog lookup may freeze its catalog (see catalog.h)
+static void summarize(log_reader& reader, int index, int count, reports::shard_result& result)
+{
+  typedef std::map<std::string, reports::warehouse*>::const_iterator walkThrough;
+
+  result.startDate = reader.startDate;
+  result.actualStartDate = reader.actualStartDate;
+  result.daysSinceStart = reader.daysSinceStart;
+
+  std::vector<reports::warehouse*> owned;
+  for(walkThrough iterator = reader.warehouseMap.begin(); iterator != reader.warehouseMap.end(); ++iterator)
+    {
+      reports::shard_warehouse house;
+      house.owned = reports::shard_of(iterator->first, count) == index;
+      house.busiestDay = iterator->second->getBusiestDay();
+      house.highestTransactions = iterator->second->getHighestTransactions();
+
+      // the top lists, kept by the shard owning the warehouse
+      if (house.owned && iterator->second->getTopRequested() != NULL)
 	{
-	  bool isStocked = false;
-	  for(walkThrough iterator = warehouseMap->begin(); iterator != warehouseMap->end(); ++iterator)
-	    {
-	      reports::warehouse* curr = iterator->second;
-	      isStocked = curr->isStocked(fIterator->first);
+	  iterator->second->getTopRequested()->top(house.topRequested);
+	  iterator->second->getTopExpired()->top(house.topExpired);
+	}
+      result.warehouses.insert(std::make_pair(iterator->first, house));
 
-	      if (!isStocked) break;
-	    }
-	  if (isStocked)
-	    {
-	      std::cout << fIterator->first << " " << fIterator->second.name << std::endl;
-	    }
+      if (house.owned)
+	owned.push_back(iterator->second);
+    }
+  if (reader.topConfig != NULL)
+    result.topK = reader.topConfig->k;
+
+  // count the owned warehouses stocking each product: one walk of each warehouse's
+  // shelves rather than a lookup for every product in every warehouse, since most
+  // products are stocked in few of them
+  reports::food_catalog& catalog = reader.foodIndex;
+  std::vector<int> stocked(catalog.size(), 0);
+  std::vector<std::string_view> codes;
+  for (std::size_t i = 0; i < owned.size(); i++)
+    {
+      codes.clear();
+      owned[i]->stockedCodes(codes);
+      for (std::size_t c = 0; c < codes.size(); c++)
+	{
+	  int id = catalog.find(codes[c]);
+	  if (id >= 0)
+	    stocked[id]++;
 	}
+    }
+
+  std::vector<int> ids = catalog.sorted();
+  for (std::size_t f = 0; f < ids.size(); f++)
+    {
+      reports::shard_food item;
+      item.name = catalog.name(ids[f]);
+      item.stocked = stocked[ids[f]];
+      result.foods.insert(result.foods.end(), std::make_pair(std::string(catalog.upc(ids[f])), item));
+    }
+}
+
+// run_worker - replays one shard log and saves its part of the report
+// parameter - top - the size of the top list sketches, NULL for none
+static int run_worker(int index, int count, const std::string& shardFile, const std::string& resultFile,
+		      const reports::sketch_config* top)
+{
+  reports::shard_result result;
+  log_reader reader;
+  reader.topConfig = top;
+  reader.messages = &result.messages;
+  read_log(shardFile, reader);
+
+  summarize(reader, index, count, result);
+  return result.write(resultFile) ? 0 : 1;
+}
+
+// scenario - one what-if continuation of a log, read from a scenario file:
+//   Scenario: <name>               starts a scenario
+//   Shelf life: <upc> <days>       receives after the fork use this shelf life (shelves
+//                                  created from then on keep it, as with the catalog)
+//   Offline: <warehouse>           the warehouse's transactions after the fork are dropped
+//   any other line                 a log line (Receive, Request ...) applied at the fork
+// warehouse names are cut like the log's Warehouse lines, so a scenario file written with
+// the same line endings as the log names the same warehouses
+struct scenario
+{
+  std::string name;
+  std::map<std::string, int> shelfLives;
+  std::set<std::string> offline;
+  std::vector<std::string> extraLines;
+};
 
-      //busiest days
-      std::cout << std::endl;
-      std::cout << "Busiest Days:" << std::endl;
-      for(walkThrough iterator = warehouseMap->begin(); iterator != warehouseMap->end(); ++iterator)
+// read_scenarios - parses a scenario file
+static bool read_scenarios(const std::string& fileName, std::vector<scenario>& scenarios)
+{
+  reports::block_reader readFile(fileName);
+  if (!readFile.is_open())
+    return false;
+
+  const std::size_t trailer = reports::standard_format::warehouse::trailer;
+  std::string_view line;
+  while (readFile.getline(line))
+    {
+      if (line.compare(0, 10, "Scenario: ") == 0)
 	{
-	  int busiestDay = iterator->second->getBusiestDay();
-	  boost::gregorian::date busiest = boost::gregorian::date(startDate);
-	  boost::gregorian::date_duration since = boost::gregorian::date_duration((long)daysSinceStart);
-	  busiest = busiest + since;
-	  std::cout << iterator->first << " " << busiest.month() << "/" << busiest.day() << "/" << busiest.year() << " " << iterator->second->getHighestTransactions() << std::endl;
+	  scenarios.push_back(scenario());
+	  std::string_view name = line.substr(10);
+	  if (!name.empty() && name.back() == '\r')
+	    name.remove_suffix(1);
+	  scenarios.back().name = name;
 	}
+      else if (scenarios.empty())
+	continue;
+      else if (line.compare(0, 12, "Shelf life: ") == 0 && line.size() >= 12)
+	{
+	  std::string_view fields = line.substr(12);
+	  std::size_t space = fields.find(' ');
+	  if (space != std::string_view::npos)
+	    scenarios.back().shelfLives[std::string(fields.substr(0, space))] = reports::parse_count(fields.substr(space + 1));
+	}
+      else if (line.compare(0, 9, "Offline: ") == 0 && line.size() >= 9 + trailer)
+	scenarios.back().offline.insert(std::string(line.substr(9, line.size() - 9 - trailer)));
+      else
+	scenarios.back().extraLines.push_back(std::string(line));
+    }
+  return true;
+}
+
+// finish - writes out the rest of the report
+// returns - the exit status: 0, or 1 if any of the report could not be written (the
+// reason goes to standard error, since standard output is what failed)
+static int finish(reports::report_writer& out)
+{
+  if (out.flush())
+    return 0;
+  std::cerr << "the report could not be written in full" << std::endl;
+  return 1;
+}
+
+// run_scenarios - replays the log up to forkDay once, forks the state for every scenario
+// and runs the scenarios' continuations on their own threads
+static int run_scenarios(int forkDay, const std::string& fileName, const std::string& scenarioFile)
+{
+  std::vector<scenario> scenarios;
+  if (!read_scenarios(scenarioFile, scenarios))
+    {
+      std::cout << "cannot read " << scenarioFile << std::endl;
+      return 1;
+    }
+
+  // the shared prefix
+  log_reader base;
+  std::vector<std::string> rest;
+  read_log(fileName, base, forkDay, &rest);
+
+  // fork every scenario before any thread starts, the base is never changed again
+  std::vector<log_reader*> forks;
+  for (std::size_t i = 0; i < scenarios.size(); i++)
+    {
+      log_reader* forked = base.fork();
+      forked->shelfLifeOverride.insert(scenarios[i].shelfLives.begin(), scenarios[i].shelfLives.end());
+      forked->offline.insert(scenarios[i].offline.begin(), scenarios[i].offline.end());
+      forks.push_back(forked);
+    }
+
+  std::vector<reports::shard_result> results(scenarios.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < scenarios.size(); i++)
+    {
+      threads.push_back(std::thread([&, i]
+				    {
+				      replay(scenarios[i].extraLines, *forks[i]);
+				      replay(rest, *forks[i]);
+				      summarize(*forks[i], 0, 1, results[i]);
+				      delete forks[i];
+				    }));
+    }
+  for (std::size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
 
-      //--- Clear memory ---//
-      for(walkThrough iterator = warehouseMap->begin(); iterator != warehouseMap->end(); ++iterator)
+  reports::report_writer out;
+  for (std::size_t i = 0; i < scenarios.size(); i++)
+    {
+      if (i > 0)
+	out << '\n';
+      out << "Scenario: " << scenarios[i].name << '\n';
+      reports::write_report(results[i], reports::text_report, out);
+    }
+  return finish(out);
+}
+
+// run_as_of - replays the whole log keeping a version of every day, then answers the
+// queries in queryFile, one per line:
+//   <day> <upc> <warehouse>        quantity of upc on hand in the warehouse at the end of
+//                                  <day> (days since the start date, as counted by the
+//                                  log's Next day lines)
+// warehouse names are cut like the log's Warehouse lines (see scenario)
+static int run_as_of(int every, const std::string& fileName, const std::string& queryFile)
+{
+  reports::block_reader queries(queryFile);
+  if (!queries.is_open())
+    {
+      std::cout << "cannot read " << queryFile << std::endl;
+      return 1;
+    }
+
+  reports::inventory_history history(every);
+  log_reader reader;
+  reader.history = &history;
+  read_log(fileName, reader);
+
+  const std::size_t trailer = reports::standard_format::warehouse::trailer;
+  reports::report_writer out;
+  std::string_view line;
+  while (queries.getline(line))
+    {
+      std::size_t upcStart = line.find(' ');
+      std::size_t nameStart = upcStart == std::string_view::npos ? upcStart : line.find(' ', upcStart + 1);
+      if (nameStart == std::string_view::npos || line.size() < nameStart + 1 + trailer)
+	continue;
+
+      int day = reports::parse_count(line.substr(0, upcStart));
+      std::string upcCode(line.substr(upcStart + 1, nameStart - upcStart - 1));
+      std::string name(line.substr(nameStart + 1, line.size() - nameStart - 1 - trailer));
+      out << day << " " << upcCode << " " << name << " " << history.onHand(day, name, upcCode) << '\n';
+    }
+  return finish(out);
+}
+
+// usage - explains the command line
+static int usage()
+{
+  std::cout << "Terminates due to wrong #s of arguments being passed, please try again and only pass 1 text file." << std::endl;
+  std::cout << "Output formats:" << std::endl;
+  std::cout << "  report --format <text|csv|jsonl|columnar> ...            for the plain, --shards and --merge reports, see report_format.h" << std::endl;
+  std::cout << "Top products:" << std::endl;
+  std::cout << "  report --top <k> [--sketch-error <epsilon> <delta>] ...   top requested and expired products per warehouse" << std::endl;
+  std::cout << "                                                          for the plain, --shards and --worker runs, see sketch.h" << std::endl;
+  std::cout << "Hardware counters:" << std::endl;
+  std::cout << "  report --counters [--format <format>] <file>            the plain report, then counters per region on standard error" << std::endl;
+  std::cout << "Sharded runs:" << std::endl;
+  std::cout << "  report --shards <count> <file>                          split, run and merge locally" << std::endl;
+  std::cout << "  report --split <count> <file> <prefix>                  write <prefix><index>.log shard logs" << std::endl;
+  std::cout << "  report --worker <index> <count> <shard log> <result>    run one shard" << std::endl;
+  std::cout << "  report --merge <result>...                              merge shard results into the report" << std::endl;
+  std::cout << "What-if scenarios:" << std::endl;
+  std::cout << "  report --scenarios <day> <file> <scenario file>         fork after <day> days, see run_scenarios" << std::endl;
+  std::cout << "As-of-day queries:" << std::endl;
+  std::cout << "  report --as-of <k> <file> <query file>                  full version every <k> days, see run_as_of" << std::endl;
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  // hardware counters (the plain report only), an output format and top lists may come
+  // first, in any order; the rest of the command line is read as without them
+  bool counted = false;
+  reports::report_format format = reports::text_report;
+  reports::sketch_config topConfig;
+  const reports::sketch_config* top = NULL;
+  for (;;)
+    {
+      std::string option = argc > 1 ? argv[1] : "";
+      int used;
+      if (option == "--counters")
+	{
+	  counted = true;
+	  used = 1;
+	}
+      else if (option == "--format" && argc > 2)
+	{
+	  if (!reports::parse_format(argv[2], format))
+	    return usage();
+	  used = 2;
+	}
+      else if (option == "--top" && argc > 2)
 	{
-	  delete iterator->second;
+	  topConfig.k = atoi(argv[2]);
+	  if (topConfig.k <= 0)
+	    return usage();
+	  top = &topConfig;
+	  used = 2;
 	}
-      warehouseMap->clear();
-      delete warehouseMap;
+      else if (option == "--sketch-error" && argc > 3)
+	{
+	  topConfig.epsilon = atof(argv[2]);
+	  topConfig.delta = atof(argv[3]);
+	  if (!(topConfig.epsilon > 0 && topConfig.epsilon < 1 && topConfig.delta > 0 && topConfig.delta < 1))
+	    return usage();
+	  used = 3;
+	}
+      else
+	break;
+      argv[used] = argv[0];
+      argv += used;
+      argc -= used;
+    }
 
+  std::string mode = argc > 1 ? argv[1] : "";
+
+  // the plain single process report
+  if (argc == 2 && mode.compare(0, 2, "--") != 0)
+    {
+      std::unique_ptr<reports::perf_counters> counters;
+      if (counted)
+	counters.reset(new reports::perf_counters());
+
+      log_reader reader;
+      reader.counters = counters.get();
+      reader.topConfig = top;
+      read_log(argv[1], reader);
+
+      int status;
+      {
+	reports::perf_scope timed(counters.get(), reports::report_region);
+	reports::shard_result result;
+	summarize(reader, 0, 1, result);
+	reports::report_writer out;
+	reports::write_report(result, format, out);
+	status = finish(out);
+      }
+      if (counters)
+	counters->print(std::cerr);
+      return status;
     }
 
-  /*std::cout << "Node C : " << reports::node::constructor_count() << std::endl;
-  std::cout << "Node D : " << reports::node::destructor_count() << std::endl;
+  // split, run the workers as child processes and merge
+  if (mode == "--shards" && argc == 4 && atoi(argv[2]) > 0)
+    {
+      int count = atoi(argv[2]);
+      reports::shard_result merged;
+      bool ok = reports::run_shards(argv[3], count,
+				    [count, top](int index, const std::string& shardFile, const std::string& resultFile)
+				    {
+				      return run_worker(index, count, shardFile, resultFile, top);
+				    },
+				    merged);
+      // run_shards has printed why
+      if (!ok)
+	return 1;
+      merged.printMessages(std::cout);
+      reports::report_writer out;
+      reports::write_report(merged, format, out);
+      return finish(out);
+    }
 
-  std::cout << "" << std::endl;
+  // the steps of a sharded run, for running workers elsewhere
+  if (mode == "--split" && argc == 5 && atoi(argv[2]) > 0)
+    {
+      try
+	{
+	  if (!reports::split_log(argv[3], atoi(argv[2]), argv[4]))
+	    return 1;
+	}
+      catch (std::exception& e)
+	{
+	  std::cout << e.what() << std::endl;
+	  std::cout << "caught exceptions when trying to read data. " << std::endl;
+	}
+      return 0;
+    }
+  if (mode == "--worker" && argc == 6 && atoi(argv[3]) > 0)
+    return run_worker(atoi(argv[2]), atoi(argv[3]), argv[4], argv[5], top);
+  if (mode == "--merge" && argc > 2)
+    {
+      reports::shard_result merged;
+      for (int i = 2; i < argc; i++)
+	{
+	  reports::shard_result part;
+	  if (!part.read(argv[i]))
+	    {
+	      std::cout << "cannot read " << argv[i] << std::endl;
+	      return 1;
+	    }
+	  merged.merge(part);
+	}
+      merged.printMessages(std::cout);
+      reports::report_writer out;
+      reports::write_report(merged, format, out);
+      return finish(out);
+    }
 
-  std::cout << "Shelf C : " << reports::shelf::constructor_count() << std::endl;
-  std::cout << "Shelf D : " << reports::shelf::destructor_count() << std::endl;
+  // what-if scenarios forked from a common prefix
+  if (mode == "--scenarios" && argc == 5)
+    return run_scenarios(atoi(argv[2]), argv[3], argv[4]);
 
-  std::cout << "" << std::endl;
+  // quantities on hand on past days
+  if (mode == "--as-of" && argc == 5 && atoi(argv[2]) > 0)
+    return run_as_of(atoi(argv[2]), argv[3], argv[4]);
 
-  std::cout << "Warehouse C : " << reports::warehouse::constructor_count() << std::endl;
-  std::cout << "warehouse D : " << reports::warehouse::destructor_count() << std::endl;
-*/
+  return usage();
 }
@@ -0,0 +1,480 @@
+//----------------------------------------------
+// report_format.cpp
+//
+// the report layouts and the parallel section formatting described in report_format.h
+//----------------------------------------------
+
+#include "report_format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "date.h"
+
+namespace reports
+{
+  typedef std::map<std::string, shard_food>::const_iterator foodWalk;
+  typedef std::map<std::string, shard_warehouse>::const_iterator walkThrough;
+
+  // products per section
+  static const std::size_t chunkSize = 1 << 16;
+
+  // reports with fewer products and warehouses than this are formatted on the calling
+  // thread, starting threads would cost more than it saves
+  static const std::size_t parallelFrom = 1 << 14;
+
+  // section - formats one part of the report into the writer it is given
+  typedef std::function<void(report_writer&)> section;
+
+  // layout - the result with its products cut into runs of chunkSize
+  struct layout
+  {
+    const shard_result& result;
+    int warehouseCount;
+
+    // the first product of every run, then the end of the products
+    std::vector<foodWalk> chunks;
+
+    // total bytes of the upc codes and names before every run (and of all of them last),
+    // for the columnar offsets
+    std::vector<std::uint32_t> upcBase;
+    std::vector<std::uint32_t> nameBase;
+
+    layout(const shard_result& i_result)
+      : result(i_result), warehouseCount((int)i_result.warehouses.size())
+    {
+      std::uint32_t upcBytes = 0;
+      std::uint32_t nameBytes = 0;
+      std::size_t count = 0;
+      for (foodWalk iterator = result.foods.begin(); iterator != result.foods.end(); ++iterator, ++count)
+	{
+	  if (count % chunkSize == 0)
+	    {
+	      chunks.push_back(iterator);
+	      upcBase.push_back(upcBytes);
+	      nameBase.push_back(nameBytes);
+	    }
+	  upcBytes += (std::uint32_t)iterator->first.size();
+	  nameBytes += (std::uint32_t)iterator->second.name.size();
+	}
+      chunks.push_back(result.foods.end());
+      upcBase.push_back(upcBytes);
+      nameBase.push_back(nameBytes);
+    }
+  };
+
+  // product_sections - adds one section per run of products, each calling line for every
+  // product of its run
+  template <class Line>
+  static void product_sections(const layout& products, std::vector<section>& sections, Line line)
+  {
+    for (std::size_t c = 0; c + 1 < products.chunks.size(); c++)
+      sections.push_back([&products, c, line](report_writer& out)
+			 {
+			   for (foodWalk iterator = products.chunks[c]; iterator != products.chunks[c + 1]; ++iterator)
+			     line(out, iterator);
+			 });
+  }
+
+  // format_sections - runs the sections and appends their text to out in order
+  // in parallel, every section gets its own memory writer and the threads take the next
+  // unformatted section until none is left
+  // on a single core the extra copy through the section buffers would only cost time
+  static void format_sections(const std::vector<section>& sections, bool parallel, report_writer& out)
+  {
+    std::size_t workers = std::thread::hardware_concurrency();
+    if (workers > sections.size())
+      workers = sections.size();
+    if (!parallel || workers < 2)
+      {
+	for (std::size_t i = 0; i < sections.size(); i++)
+	  sections[i](out);
+	return;
+      }
+
+    std::vector<std::unique_ptr<report_writer> > parts;
+    for (std::size_t i = 0; i < sections.size(); i++)
+      parts.emplace_back(new report_writer(-1));
+
+    std::atomic<std::size_t> next(0);
+    std::function<void()> work = [&]
+      {
+	for (std::size_t i = next.fetch_add(1); i < sections.size(); i = next.fetch_add(1))
+	  sections[i](*parts[i]);
+      };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < workers; i++)
+      threads.push_back(std::thread(work));
+    work();
+    for (std::size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+
+    for (std::size_t i = 0; i < parts.size(); i++)
+      out << parts[i]->text();
+  }
+
+  //--- field encodings ---//
+
+  // csv_field - quotes the text if it holds a separator, quote or line break
+  static void csv_field(report_writer& out, std::string_view text)
+  {
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+      {
+	out << text;
+	return;
+      }
+
+    out << '"';
+    for (std::size_t i = 0; i < text.size(); i++)
+      {
+	if (text[i] == '"')
+	  out << '"';
+	out << text[i];
+      }
+    out << '"';
+  }
+
+  // json_string - writes the text as a JSON string, escaping quotes, backslashes and
+  // control characters
+  static void json_string(report_writer& out, std::string_view text)
+  {
+    static const char hex[] = "0123456789abcdef";
+    out << '"';
+    std::size_t plain = 0;
+    for (std::size_t i = 0; i < text.size(); i++)
+      {
+	unsigned char c = (unsigned char)text[i];
+	if (c >= 0x20 && c != '"' && c != '\\')
+	  continue;
+
+	out << text.substr(plain, i - plain);
+	plain = i + 1;
+	if (c == '"' || c == '\\')
+	  out << '\\' << (char)c;
+	else
+	  out << "\\u00" << hex[c >> 4] << hex[c & 15];
+      }
+    out << text.substr(plain) << '"';
+  }
+
+  // iso_date - writes days since 1970-01-01 as YYYY-MM-DD
+  static void iso_date(report_writer& out, int days)
+  {
+    char date[16];
+    std::size_t length = format_iso_date(days, date);
+    out << std::string_view(date, length);
+  }
+
+  // put_int - writes a 32 bit little endian integer
+  static void put_int(report_writer& out, std::uint32_t value)
+  {
+    char bytes[4] = { (char)(value & 0xff), (char)((value >> 8) & 0xff),
+		      (char)((value >> 16) & 0xff), (char)((value >> 24) & 0xff) };
+    out << std::string_view(bytes, 4);
+  }
+
+  // put_date - writes a date as a signed 32 bit little endian integer (two's complement),
+  // so dates before 1970-01-01 come out negative rather than as large counts
+  static void put_date(report_writer& out, int days)
+  {
+    put_int(out, (std::uint32_t)(std::int32_t)days);
+  }
+
+  typedef std::vector<std::pair<std::string, long long> > top_list;
+
+  // product_name - the catalog name of a upc code, empty for a code never declared
+  static std::string_view product_name(const shard_result& result, const std::string& upc)
+  {
+    foodWalk found = result.foods.find(upc);
+    if (found == result.foods.end())
+      return std::string_view();
+    return found->second.name;
+  }
+
+  // top_rows - calls row for every entry of the requested top lists, then of the expired
+  // ones, with the record name, the warehouse and the rank (from 1)
+  template <class Row>
+  static void top_rows(const shard_result& result, Row row)
+  {
+    for (int expired = 0; expired < 2; expired++)
+      for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+	{
+	  const top_list& list = expired ? iterator->second.topExpired : iterator->second.topRequested;
+	  for (std::size_t i = 0; i < list.size(); i++)
+	    row(expired ? "top_expired" : "top_requested", iterator->first, (int)i + 1, list[i]);
+	}
+  }
+
+  //--- layouts ---//
+
+  // text_sections - the original report
+  // a product is unstocked if no warehouse stocks it, and fully stocked if every one
+  // does (with no warehouses at all it is neither)
+  static void text_sections(const layout& products, std::vector<section>& sections)
+  {
+    int warehouseCount = products.warehouseCount;
+    sections.push_back([](report_writer& out)
+		       {
+			 out << "Report by Colin & Minwen" << '\n';
+			 out << '\n';
+			 out << "Unstocked Products:" << '\n';
+		       });
+    product_sections(products, sections, [warehouseCount](report_writer& out, foodWalk iterator)
+		     {
+		       if (warehouseCount > 0 && iterator->second.stocked == 0)
+			 out << iterator->first << " " << iterator->second.name << '\n';
+		     });
+
+    sections.push_back([](report_writer& out)
+		       {
+			 out << '\n';
+			 out << "Fully-Stocked Products: " << '\n';
+		       });
+    product_sections(products, sections, [warehouseCount](report_writer& out, foodWalk iterator)
+		     {
+		       if (warehouseCount > 0 && iterator->second.stocked == warehouseCount)
+			 out << iterator->first << " " << iterator->second.name << '\n';
+		     });
+
+    //busiest days
+    const shard_result& result = products.result;
+    sections.push_back([&result](report_writer& out)
+		       {
+			 out << '\n';
+			 out << "Busiest Days:" << '\n';
+			 char busiest[16];
+			 std::size_t busiestLength = format_date(result.startDate + result.daysSinceStart, busiest);
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   out << iterator->first << " " << std::string_view(busiest, busiestLength) << " " << iterator->second.highestTransactions << '\n';
+		       });
+
+    // the top lists, only with --top: warehouse, upc, name and estimated quantity
+    if (result.topK > 0)
+      sections.push_back([&result](report_writer& out)
+			 {
+			   for (int expired = 0; expired < 2; expired++)
+			     {
+			       out << '\n';
+			       out << (expired ? "Top Expired Products:" : "Top Requested Products:") << '\n';
+			       for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+				 {
+				   const top_list& list = expired ? iterator->second.topExpired : iterator->second.topRequested;
+				   for (std::size_t i = 0; i < list.size(); i++)
+				     out << iterator->first << " " << list[i].first << " " << product_name(result, list[i].first)
+					 << " " << list[i].second << '\n';
+				 }
+			     }
+			 });
+  }
+
+  // csv_sections - header row, product rows, warehouse rows, then with --top the top list
+  // rows, which add a warehouse and an estimate column (left empty on the other rows)
+  static void csv_sections(const layout& products, std::vector<section>& sections)
+  {
+    int warehouseCount = products.warehouseCount;
+    const shard_result& result = products.result;
+    std::string_view extra = result.topK > 0 ? ",," : "";
+    sections.push_back([extra](report_writer& out)
+		       {
+			 out << "record,upc,name,stocked,warehouses,busiest_day,transactions";
+			 if (!extra.empty())
+			   out << ",warehouse,estimate";
+			 out << '\n';
+		       });
+    product_sections(products, sections, [warehouseCount, extra](report_writer& out, foodWalk iterator)
+		     {
+		       out << "product,";
+		       csv_field(out, iterator->first);
+		       out << ',';
+		       csv_field(out, iterator->second.name);
+		       out << ',' << iterator->second.stocked << ',' << warehouseCount << ",," << extra << '\n';
+		     });
+
+    sections.push_back([&result, extra](report_writer& out)
+		       {
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   {
+			     out << "warehouse,,";
+			     csv_field(out, iterator->first);
+			     out << ",,,";
+			     iso_date(out, result.actualStartDate + iterator->second.busiestDay);
+			     out << ',' << iterator->second.highestTransactions << extra << '\n';
+			   }
+		       });
+
+    if (result.topK > 0)
+      sections.push_back([&result](report_writer& out)
+			 {
+			   top_rows(result, [&result, &out](const char* record, const std::string& house, int,
+							    const std::pair<std::string, long long>& entry)
+				    {
+				      out << record << ',';
+				      csv_field(out, entry.first);
+				      out << ',';
+				      csv_field(out, product_name(result, entry.first));
+				      out << ",,,,,";
+				      csv_field(out, house);
+				      out << ',' << entry.second << '\n';
+				    });
+			 });
+  }
+
+  // jsonl_sections - one object per product, then one per warehouse
+  static void jsonl_sections(const layout& products, std::vector<section>& sections)
+  {
+    int warehouseCount = products.warehouseCount;
+    product_sections(products, sections, [warehouseCount](report_writer& out, foodWalk iterator)
+		     {
+		       out << "{\"record\":\"product\",\"upc\":";
+		       json_string(out, iterator->first);
+		       out << ",\"name\":";
+		       json_string(out, iterator->second.name);
+		       out << ",\"stocked\":" << iterator->second.stocked << ",\"warehouses\":" << warehouseCount << '}' << '\n';
+		     });
+
+    const shard_result& result = products.result;
+    sections.push_back([&result](report_writer& out)
+		       {
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   {
+			     out << "{\"record\":\"warehouse\",\"name\":";
+			     json_string(out, iterator->first);
+			     out << ",\"busiest_day\":\"";
+			     iso_date(out, result.actualStartDate + iterator->second.busiestDay);
+			     out << "\",\"transactions\":" << iterator->second.highestTransactions << '}' << '\n';
+			   }
+		       });
+
+    if (result.topK > 0)
+      sections.push_back([&result](report_writer& out)
+			 {
+			   top_rows(result, [&result, &out](const char* record, const std::string& house, int rank,
+							    const std::pair<std::string, long long>& entry)
+				    {
+				      out << "{\"record\":\"" << record << "\",\"warehouse\":";
+				      json_string(out, house);
+				      out << ",\"rank\":" << rank << ",\"upc\":";
+				      json_string(out, entry.first);
+				      out << ",\"name\":";
+				      json_string(out, product_name(result, entry.first));
+				      out << ",\"estimate\":" << entry.second << '}' << '\n';
+				    });
+			 });
+  }
+
+  // columnar_sections - the header, then every column, each cut into runs of products
+  static void columnar_sections(const layout& products, std::vector<section>& sections)
+  {
+    const shard_result& result = products.result;
+    sections.push_back([&result](report_writer& out)
+		       {
+			 out << "WRCOLS01";
+			 put_int(out, (std::uint32_t)result.foods.size());
+			 put_int(out, (std::uint32_t)result.warehouses.size());
+			 put_date(out, result.actualStartDate);
+			 put_int(out, (std::uint32_t)result.daysSinceStart);
+		       });
+
+    product_sections(products, sections, [](report_writer& out, foodWalk iterator)
+		     {
+		       put_int(out, (std::uint32_t)iterator->second.stocked);
+		     });
+
+    // offset columns: each run starts from the bytes of the runs before it
+    for (int column = 0; column < 2; column++)
+      {
+	const std::vector<std::uint32_t>& base = column == 0 ? products.upcBase : products.nameBase;
+	for (std::size_t c = 0; c + 1 < products.chunks.size(); c++)
+	  sections.push_back([&products, &base, c, column](report_writer& out)
+			     {
+			       std::uint32_t offset = base[c];
+			       for (foodWalk iterator = products.chunks[c]; iterator != products.chunks[c + 1]; ++iterator)
+				 {
+				   put_int(out, offset);
+				   offset += (std::uint32_t)(column == 0 ? iterator->first.size() : iterator->second.name.size());
+				 }
+			     });
+	sections.push_back([&base](report_writer& out)
+			   {
+			     put_int(out, base.back());
+			   });
+      }
+
+    // warehouse columns, a handful of rows each
+    sections.push_back([&result](report_writer& out)
+		       {
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   put_date(out, result.actualStartDate + iterator->second.busiestDay);
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   put_int(out, (std::uint32_t)iterator->second.highestTransactions);
+
+			 std::uint32_t offset = 0;
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   {
+			     put_int(out, offset);
+			     offset += (std::uint32_t)iterator->first.size();
+			   }
+			 put_int(out, offset);
+		       });
+
+    // the bytes
+    product_sections(products, sections, [](report_writer& out, foodWalk iterator)
+		     {
+		       out << iterator->first;
+		     });
+    product_sections(products, sections, [](report_writer& out, foodWalk iterator)
+		     {
+		       out << iterator->second.name;
+		     });
+    sections.push_back([&result](report_writer& out)
+		       {
+			 for (walkThrough iterator = result.warehouses.begin(); iterator != result.warehouses.end(); ++iterator)
+			   out << iterator->first;
+		       });
+  }
+
+  bool parse_format(std::string_view name, report_format& format)
+  {
+    if (name == "text")
+      format = text_report;
+    else if (name == "csv")
+      format = csv_report;
+    else if (name == "jsonl")
+      format = jsonl_report;
+    else if (name == "columnar")
+      format = columnar_report;
+    else
+      return false;
+    return true;
+  }
+
+  // write_report - lays out the sections of the format, then formats them
+  void write_report(const shard_result& result, report_format format, report_writer& out)
+  {
+    layout products(result);
+    std::vector<section> sections;
+    switch (format)
+      {
+      case text_report:
+	text_sections(products, sections);
+	break;
+      case csv_report:
+	csv_sections(products, sections);
+	break;
+      case jsonl_report:
+	jsonl_sections(products, sections);
+	break;
+      case columnar_report:
+	columnar_sections(products, sections);
+	break;
+      }
+
+    bool parallel = result.foods.size() + result.warehouses.size() >= parallelFrom;
+    format_sections(sections, parallel, out);
+  }
+}
@@ -0,0 +1,69 @@
+//--------------------------------------------
+// report_format.h
+//
+// the layouts a report can be written in
+// - text: the original report (Unstocked Products, Fully-Stocked Products, Busiest Days)
+// - csv: one row per product and per warehouse, with a header row
+//     record,upc,name,stocked,warehouses,busiest_day,transactions
+//     product,<upc>,<name>,<warehouses stocking it>,<warehouse count>,,
+//     warehouse,,<name>,,,<busiest day YYYY-MM-DD>,<transactions on that day>
+//   fields holding a comma, quote or line break are quoted, quotes doubled
+// - jsonl: one JSON object per line, with the same fields
+//     {"record":"product","upc":...,"name":...,"stocked":3,"warehouses":5}
+//     {"record":"warehouse","name":...,"busiest_day":"2014-01-05","transactions":120}
+// - columnar: a binary file of columns, all integers 32 bit little endian, dates signed
+//   (two's complement) and every other integer unsigned
+//     header       "WRCOLS01", products P, warehouses W, start date, days since start
+//     stocked      P ints, warehouses stocking each product
+//     upc          P + 1 offsets into the upc bytes
+//     name         P + 1 offsets into the product name bytes
+//     busiest day  W ints, days since 1970-01-01
+//     transactions W ints
+//     warehouse    W + 1 offsets into the warehouse name bytes
+//     then the upc bytes, the product name bytes and the warehouse name bytes
+//   products and warehouses are in name (upc) order, as in the text report
+//   dates are days since 1970-01-01 (see date.h), negative before it
+// with --top k (see sketch.h) each warehouse's top requested and expired products follow:
+// - text: "Top Requested Products:" and "Top Expired Products:" sections of lines
+//     <warehouse> <upc> <name> <estimate>
+// - csv: two more columns, warehouse and estimate (empty in the other rows)
+//     top_requested,<upc>,<name>,,,,,<warehouse>,<estimate>   (top_expired likewise)
+// - jsonl: {"record":"top_requested","warehouse":...,"rank":1,"upc":...,"name":...,"estimate":N}
+// - columnar: not written; the file layout is unchanged
+// the machine readable formats give the start date and each warehouse's actual busiest day,
+// counted from the month, day and year of the log's Start line; the text report keeps
+// printing the date it always printed (the last day of the log, from the start date as
+// the old parsing combined it, see log_reader::start in report.cpp)
+//
+// the report is cut into sections (titles, runs of up to 64k products, the warehouses,
+// or the columns) which are formatted on separate threads into their own buffers and
+// then appended in order, so even a catalog of millions of products is written quickly
+//--------------------------------------------
+
+#ifndef REPORT_FORMAT_H
+#define REPORT_FORMAT_H
+
+#include <string_view>
+
+#include "report_writer.h"
+#include "shard.h"
+
+namespace reports
+{
+  enum report_format
+  {
+    text_report,
+    csv_report,
+    jsonl_report,
+    columnar_report
+  };
+
+  // parse_format - turns "text", "csv", "jsonl" or "columnar" into a format
+  // returns - false for any other name
+  bool parse_format(std::string_view name, report_format& format);
+
+  // write_report - formats the report and appends it to out
+  void write_report(const shard_result& result, report_format format, report_writer& out);
+}
+
+#endif
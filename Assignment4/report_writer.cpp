@@ -0,0 +1,115 @@
+//----------------------------------------------
+// report_writer.cpp
+//
+// class function definitions for report_writer
+// a more detailed description can be found in report_writer.h
+//----------------------------------------------
+
+#include "report_writer.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace reports
+{
+  // constructor - reserves room for the whole report up front
+  report_writer::report_writer(int i_fd, std::size_t i_limit)
+    : fd(i_fd), limit(i_limit), failed(false)
+  {
+    buffer.reserve(1 << 20);
+  }
+
+  // destructor - writes out anything still buffered
+  report_writer::~report_writer()
+  {
+    flush();
+  }
+
+  report_writer& report_writer::operator<<(std::string_view text)
+  {
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    if (buffer.size() >= limit)
+      flush();
+    return *this;
+  }
+
+  report_writer& report_writer::operator<<(const char* text)
+  {
+    return *this << std::string_view(text);
+  }
+
+  report_writer& report_writer::operator<<(const std::string& text)
+  {
+    return *this << std::string_view(text);
+  }
+
+  report_writer& report_writer::operator<<(char c)
+  {
+    buffer.push_back(c);
+    if (buffer.size() >= limit)
+      flush();
+    return *this;
+  }
+
+  report_writer& report_writer::operator<<(int value)
+  {
+    return *this << (long long)value;
+  }
+
+  // formats the number into a small stack buffer from the right
+  report_writer& report_writer::operator<<(long long value)
+  {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = end;
+
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do
+      {
+	*--begin = char('0' + magnitude % 10);
+	magnitude /= 10;
+      }
+    while (magnitude != 0);
+
+    if (value < 0)
+      *--begin = '-';
+
+    return *this << std::string_view(begin, end - begin);
+  }
+
+  // flush - write can accept less than asked for, so loop until the buffer is drained
+  // a write that fails (or writes nothing) marks the writer failed for good, since the
+  // text after it would leave a hole in the report
+  // a memory only writer keeps everything
+  bool report_writer::flush()
+  {
+    if (fd < 0)
+      return true;
+
+    std::size_t done = 0;
+    while (done < buffer.size() && !failed)
+      {
+	ssize_t n = write(fd, &buffer[done], buffer.size() - done);
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n <= 0)
+	  failed = true;
+	else
+	  done += n;
+      }
+    buffer.clear();
+    return !failed;
+  }
+
+  std::size_t report_writer::size() const
+  {
+    return buffer.size();
+  }
+
+  std::string_view report_writer::text() const
+  {
+    return std::string_view(buffer.data(), buffer.size());
+  }
+}
@@ -0,0 +1,67 @@
+//--------------------------------------------
+// report_writer.h
+//
+// header for the report_writer class
+// a report_writer collects the report text in one large user-space buffer and writes it
+// to a file descriptor with as few write calls as possible (one for any normal report),
+// instead of flushing std::cout after every line
+// a writer built with a descriptor of -1 only collects text in memory, so parts of a
+// report can be formatted separately (even on other threads) and appended in order
+//--------------------------------------------
+
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace reports
+{
+  class report_writer
+  {
+  public:
+    // constructor - builds a writer for the given descriptor (standard output by default)
+    // parameter - fd - descriptor the report is written to, -1 to keep it in memory
+    // parameter - limit - buffered bytes at which the buffer is written out early
+    report_writer(int fd = 1, std::size_t limit = 64 << 20);
+
+    // destructor - writes out anything still buffered; call flush first to learn whether
+    // that worked
+    ~report_writer();
+
+    // operators for appending text and numbers, in the style of std::ostream
+    report_writer& operator<<(std::string_view text);
+    report_writer& operator<<(const char* text);
+    report_writer& operator<<(const std::string& text);
+    report_writer& operator<<(char c);
+    report_writer& operator<<(int value);
+    report_writer& operator<<(long long value);
+
+    // flush - writes the buffered text to the descriptor
+    // returns - false if this or any earlier write to the descriptor failed or stopped
+    // short (a full disk, a closed pipe), so the report on it is incomplete
+    bool flush();
+
+    // size - returns the number of bytes currently buffered
+    std::size_t size() const;
+
+    // text - returns the buffered bytes
+    std::string_view text() const;
+
+  private:
+    // no copying, the buffer would be written twice
+    report_writer(const report_writer&);
+    report_writer& operator=(const report_writer&);
+
+    int fd;
+    std::size_t limit;
+    std::vector<char> buffer;
+
+    // true once a write failed; the rest of the report is dropped
+    bool failed;
+  };
+}
+
+#endif
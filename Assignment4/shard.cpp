@@ -0,0 +1,438 @@
+//----------------------------------------------
+// shard.cpp
+//
+// function definitions for running a report as several worker processes
+// a full description can be found in shard.h
+//----------------------------------------------
+
+#include "shard.h"
+#include "record.h"
+#include "block_reader.h"
+#include "report_writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace reports
+{
+  shard_result::shard_result()
+    : startDate(0), actualStartDate(0), daysSinceStart(0), topK(0)
+  {
+  }
+
+  // merge - stock counts add up, a warehouse's busiest day is taken from its owner
+  void shard_result::merge(const shard_result& other)
+  {
+    startDate = other.startDate;
+    actualStartDate = other.actualStartDate;
+    daysSinceStart = other.daysSinceStart;
+    if (other.topK > topK)
+      topK = other.topK;
+
+    // a line already reported by another shard keeps that shard's messages
+    messages.insert(other.messages.begin(), other.messages.end());
+
+    typedef std::map<std::string, shard_food>::const_iterator foodWalk;
+    for (foodWalk iterator = other.foods.begin(); iterator != other.foods.end(); ++iterator)
+      {
+	std::map<std::string, shard_food>::iterator found = foods.find(iterator->first);
+	if (found == foods.end())
+	  foods.insert(*iterator);
+	else
+	  found->second.stocked += iterator->second.stocked;
+      }
+
+    typedef std::map<std::string, shard_warehouse>::const_iterator walkThrough;
+    for (walkThrough iterator = other.warehouses.begin(); iterator != other.warehouses.end(); ++iterator)
+      {
+	std::map<std::string, shard_warehouse>::iterator found = warehouses.find(iterator->first);
+	if (found == warehouses.end())
+	  warehouses.insert(*iterator);
+	else if (iterator->second.owned)
+	  found->second = iterator->second;
+      }
+  }
+
+  // write - one record per line, numbers first and the name last after a tab, since
+  // names can contain spaces
+  //   days <startDate> <daysSinceStart> <actualStartDate>
+  //   food <stocked> <upc>\t<name>
+  //   warehouse <owned> <busiestDay> <highestTransactions>\t<name>
+  // and with top lists
+  //   top <k>
+  //   requested <estimate> <upc>\t<warehouse name>    (after that warehouse's line)
+  //   expired <estimate> <upc>\t<warehouse name>
+  // and a line per diagnostic
+  //   message <log line number>\t<text>
+  bool shard_result::write(const std::string& fileName) const
+  {
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    bool written;
+    {
+      report_writer out(fd);
+      out << "days " << startDate << ' ' << daysSinceStart << ' ' << actualStartDate << '\n';
+      if (topK > 0)
+	out << "top " << topK << '\n';
+
+      typedef std::map<std::string, shard_food>::const_iterator foodWalk;
+      for (foodWalk iterator = foods.begin(); iterator != foods.end(); ++iterator)
+	out << "food " << iterator->second.stocked << ' ' << iterator->first << '\t' << iterator->second.name << '\n';
+
+      typedef std::map<std::string, shard_warehouse>::const_iterator walkThrough;
+      for (walkThrough iterator = warehouses.begin(); iterator != warehouses.end(); ++iterator)
+	{
+	  out << "warehouse " << (iterator->second.owned ? 1 : 0) << ' ' << iterator->second.busiestDay << ' '
+	      << iterator->second.highestTransactions << '\t' << iterator->first << '\n';
+	  for (std::size_t i = 0; i < iterator->second.topRequested.size(); i++)
+	    out << "requested " << iterator->second.topRequested[i].second << ' '
+		<< iterator->second.topRequested[i].first << '\t' << iterator->first << '\n';
+	  for (std::size_t i = 0; i < iterator->second.topExpired.size(); i++)
+	    out << "expired " << iterator->second.topExpired[i].second << ' '
+		<< iterator->second.topExpired[i].first << '\t' << iterator->first << '\n';
+	}
+
+      typedef std::map<long long, std::vector<std::string> >::const_iterator messageWalk;
+      for (messageWalk iterator = messages.begin(); iterator != messages.end(); ++iterator)
+	for (std::size_t i = 0; i < iterator->second.size(); i++)
+	  out << "message " << iterator->first << '\t' << iterator->second[i] << '\n';
+      written = out.flush();
+    }
+    return close(fd) == 0 && written;
+  }
+
+  // read - parses the lines written by write
+  bool shard_result::read(const std::string& fileName)
+  {
+    std::ifstream file(fileName.c_str());
+    if (!file)
+      return false;
+
+    std::string line;
+    while (std::getline(file, line))
+      {
+	std::string::size_type tab = line.find('\t');
+	std::string name = tab == std::string::npos ? std::string() : line.substr(tab + 1);
+	const char* fields = line.c_str();
+	char* next;
+
+	if (line.compare(0, 5, "days ") == 0)
+	  {
+	    startDate = strtol(fields + 5, &next, 10);
+	    daysSinceStart = strtol(next, &next, 10);
+	    actualStartDate = strtol(next, &next, 10);
+	  }
+	else if (line.compare(0, 5, "food ") == 0 && tab != std::string::npos)
+	  {
+	    shard_food food;
+	    food.stocked = strtol(fields + 5, &next, 10);
+	    food.name = name;
+	    std::string::size_type upcStart = next - fields + 1;
+	    foods[line.substr(upcStart, tab - upcStart)] = food;
+	  }
+	else if (line.compare(0, 10, "warehouse ") == 0 && tab != std::string::npos)
+	  {
+	    shard_warehouse& house = warehouses[name];
+	    house.owned = strtol(fields + 10, &next, 10) != 0;
+	    house.busiestDay = strtol(next, &next, 10);
+	    house.highestTransactions = strtol(next, &next, 10);
+	  }
+	else if (line.compare(0, 4, "top ") == 0)
+	  topK = strtol(fields + 4, &next, 10);
+	else if ((line.compare(0, 10, "requested ") == 0 || line.compare(0, 8, "expired ") == 0)
+		 && tab != std::string::npos)
+	  {
+	    bool requested = line[0] == 'r';
+	    long long estimate = strtoll(fields + (requested ? 10 : 8), &next, 10);
+	    std::string::size_type upcStart = next - fields + 1;
+	    shard_warehouse& house = warehouses[name];
+	    (requested ? house.topRequested : house.topExpired)
+	      .push_back(std::make_pair(line.substr(upcStart, tab - upcStart), estimate));
+	  }
+	else if (line.compare(0, 8, "message ") == 0 && tab != std::string::npos)
+	  messages[strtoll(fields + 8, &next, 10)].push_back(name);
+      }
+    return true;
+  }
+
+  void shard_result::printMessages(std::ostream& out) const
+  {
+    typedef std::map<long long, std::vector<std::string> >::const_iterator messageWalk;
+    for (messageWalk iterator = messages.begin(); iterator != messages.end(); ++iterator)
+      for (std::size_t i = 0; i < iterator->second.size(); i++)
+	out << iterator->second[i] << '\n';
+    out.flush();
+  }
+
+  // line_marker - "Line: " then the number
+  bool line_marker(std::string_view line, long long& number)
+  {
+    if (line.compare(0, 6, "Line: ") != 0)
+      return false;
+    number = strtoll(std::string(line.substr(6)).c_str(), NULL, 10);
+    return true;
+  }
+
+  // shard_of - FNV-1a hash of the name
+  int shard_of(std::string_view warehouseName, int count)
+  {
+    unsigned int hash = 2166136261u;
+    for (std::size_t i = 0; i < warehouseName.size(); i++)
+      {
+	hash ^= (unsigned char)warehouseName[i];
+	hash *= 16777619u;
+      }
+    return (int)(hash % (unsigned int)count);
+  }
+
+  // split_router - record handler which works out where the current line goes
+  // target stays -1 (every shard) unless the line is a transaction
+  struct split_router
+  {
+    int count;
+    int target;
+
+    // set by a transfer between warehouses of different shards
+    bool crossed;
+
+    // declared warehouse names, for splitting the names of a transfer
+    std::set<std::string, std::less<> > names;
+
+    void foodItem(std::string_view, int, std::string_view) {}
+
+    void warehouse(std::string_view name)
+    {
+      names.insert(std::string(name));
+    }
+
+    void start(std::string_view, std::string_view, std::string_view) {}
+    void nextDay() {}
+
+    void receive(std::string_view, int, std::string_view name)
+    {
+      target = shard_of(name, count);
+    }
+
+    void request(std::string_view, int, std::string_view name)
+    {
+      target = shard_of(name, count);
+    }
+
+    // a transfer needs the shelves of both warehouses, so they must share a shard; one
+    // between shards cannot be replayed by independent workers and fails the split
+    // (names which are not both warehouses go to every shard, to be reported there)
+    void transfer(std::string_view, int, std::string_view fromTo, std::size_t trim)
+    {
+      std::string_view from;
+      std::string_view to;
+      const std::set<std::string, std::less<> >& known = names;
+      if (!split_names(fromTo, trim, [&known](std::string_view name) { return known.find(name) != known.end(); }, from, to))
+	return;
+
+      target = shard_of(from, count);
+      if (shard_of(to, count) != target)
+	crossed = true;
+    }
+  };
+
+  // split_log - routes each line with split_router
+  bool split_log(const std::string& fileName, int count, const std::string& prefix)
+  {
+    block_reader readFile(fileName);
+    if (!readFile.is_open())
+      {
+	std::cout << "cannot read " << fileName << std::endl;
+	return false;
+      }
+
+    // one buffered writer per shard log
+    std::vector<int> files(count, -1);
+    std::vector<report_writer*> shards(count, (report_writer*)NULL);
+    bool opened = true;
+    for (int i = 0; i < count; i++)
+      {
+	char suffix[32];
+	std::snprintf(suffix, sizeof(suffix), "%d.log", i);
+	files[i] = open((prefix + suffix).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (files[i] < 0)
+	  opened = false;
+	else
+	  shards[i] = new report_writer(files[i], 4 << 20);
+      }
+
+    // close every shard log even if a line throws
+    struct closer
+    {
+      std::vector<int>& files;
+      std::vector<report_writer*>& shards;
+      ~closer()
+      {
+	for (std::size_t i = 0; i < shards.size(); i++)
+	  {
+	    delete shards[i];
+	    if (files[i] >= 0)
+	      close(files[i]);
+	  }
+      }
+    } closeAll = { files, shards };
+
+    if (!opened)
+      {
+	std::cout << "cannot write the shard logs " << prefix << "<n>.log" << std::endl;
+	return false;
+      }
+
+    split_router router;
+    router.count = count;
+    router.crossed = false;
+
+    // the number of the line read, and of the line each shard log expects next
+    long long number = 0;
+    std::vector<long long> expected(count, 1);
+    std::string_view line;
+    while (readFile.getline(line))
+      {
+	number++;
+	router.target = -1;
+	bool more = parse_record<standard_format>(line, router);
+	if (router.crossed)
+	  {
+	    std::cout << "cannot split line " << number << ": " << line << " moves stock between shards" << std::endl;
+	    return false;
+	  }
+
+	for (int i = 0; i < count; i++)
+	  if (router.target < 0 || router.target == i)
+	    {
+	      if (expected[i] != number)
+		*shards[i] << "Line: " << number << '\n';
+	      *shards[i] << line << '\n';
+	      expected[i] = number + 1;
+	    }
+
+	if (!more)
+	  break;
+      }
+
+    // a shard log cut short would make its worker report less than the log holds
+    bool written = true;
+    for (int i = 0; i < count; i++)
+      if (!shards[i]->flush())
+	{
+	  std::cout << "cannot write the shard log " << prefix << i << ".log" << std::endl;
+	  written = false;
+	}
+    return written;
+  }
+
+  // run_shards - split, fork a worker per shard, wait for them and merge
+  bool run_shards(const std::string& fileName, int count,
+		  const std::function<int(int, const std::string&, const std::string&)>& worker,
+		  shard_result& merged)
+  {
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string(tmp != NULL ? tmp : "/tmp") + "/report-shards-XXXXXX";
+    std::vector<char> directory(pattern.begin(), pattern.end());
+    directory.push_back('\0');
+    if (mkdtemp(&directory[0]) == NULL)
+      {
+	std::cout << "cannot make a directory for the shards in " << pattern << std::endl;
+	return false;
+      }
+    std::string prefix = std::string(&directory[0]) + "/shard-";
+
+    bool ok = true;
+    try
+      {
+	ok = split_log(fileName, count, prefix);
+      }
+    catch (std::exception& e)
+      {
+	// the shards hold everything before the bad line, as a single run would; reading
+	// stops there, so it is reported after every other line
+	std::vector<std::string>& last = merged.messages[std::numeric_limits<long long>::max()];
+	last.push_back(e.what());
+	last.push_back("caught exceptions when trying to read data. ");
+      }
+
+    std::vector<std::string> logs(count);
+    std::vector<std::string> results(count);
+    for (int i = 0; i < count; i++)
+      {
+	char suffix[32];
+	std::snprintf(suffix, sizeof(suffix), "%d", i);
+	logs[i] = prefix + suffix + ".log";
+	results[i] = prefix + suffix + ".result";
+      }
+
+    // anything buffered in std::cout would otherwise be printed again by each child
+    std::cout.flush();
+
+    std::vector<pid_t> children;
+    for (int i = 0; ok && i < count; i++)
+      {
+	pid_t child = fork();
+	if (child == 0)
+	  {
+	    int status = worker(i, logs[i], results[i]);
+	    std::cout.flush();
+	    _exit(status);
+	  }
+	if (child < 0)
+	  {
+	    std::cout << "cannot start the worker for shard " << i << std::endl;
+	    ok = false;
+	  }
+	else
+	  children.push_back(child);
+      }
+
+    // children were started in shard order, so children[i] is shard i
+    for (std::size_t i = 0; i < children.size(); i++)
+      {
+	int status = 0;
+	if (waitpid(children[i], &status, 0) < 0)
+	  status = -1;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	  {
+	    std::cout << "the worker for shard " << i << " (" << logs[i] << ") ";
+	    if (status == -1)
+	      std::cout << "was lost" << std::endl;
+	    else if (WIFSIGNALED(status))
+	      std::cout << "was killed by signal " << WTERMSIG(status) << std::endl;
+	    else
+	      std::cout << "failed with exit status " << WEXITSTATUS(status) << std::endl;
+	    ok = false;
+	  }
+      }
+
+    for (int i = 0; ok && i < count; i++)
+      {
+	shard_result part;
+	if (!part.read(results[i]))
+	  {
+	    std::cout << "cannot read the result of shard " << i << " (" << results[i] << ")" << std::endl;
+	    ok = false;
+	  }
+	else
+	  merged.merge(part);
+      }
+
+    for (int i = 0; i < count; i++)
+      {
+	std::remove(logs[i].c_str());
+	std::remove(results[i].c_str());
+      }
+    rmdir(&directory[0]);
+    return ok;
+  }
+}
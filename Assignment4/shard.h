@@ -0,0 +1,125 @@
+//--------------------------------------------
+// shard.h
+//
+// support for running one report as several independent worker processes
+//
+// the log is split by a hash of the warehouse name into N shard logs: Receive and
+// Request lines go to the shard owning their warehouse, Transfer lines to the shard
+// owning both of theirs (a log moving stock between shards cannot be split), every other line (food items,
+// warehouse declarations, the start date, next day and end markers) is copied to all
+// shards so each worker sees the full catalog and calendar
+// each worker replays its shard and writes a shard_result file holding everything the
+// final report needs from it: per UPC how many of its own warehouses stock it, the
+// busiest day of each of its own warehouses, and the diagnostics ("map::at", "caught
+// something in receive.") a single run would have printed for its lines
+// a shard log holds "Line: <n>" lines wherever its lines stop following on from each
+// other in the original log, so those diagnostics carry the original line numbers and
+// the merge prints them in log order, as a single run does
+// merging the results of all shards gives exactly the single process report, since a
+// product is unstocked when every shard counts 0 and fully stocked when the counts add
+// up to the number of warehouses
+//
+// workers only communicate through files, so they can run as local child processes
+// (run_shards) or on other machines with the shard logs copied over
+//--------------------------------------------
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace reports
+{
+  // shard_food - a catalog entry and the number of warehouses stocking it
+  struct shard_food
+  {
+    std::string name;
+    int stocked;
+  };
+
+  // shard_warehouse - busiest day data of a warehouse, owned is true if the shard
+  // holding it is the one its transactions were routed to
+  // with --top, also its most requested and most expired products as (upc, estimated
+  // quantity) pairs, largest first (see sketch.h)
+  struct shard_warehouse
+  {
+    bool owned;
+    int busiestDay;
+    int highestTransactions;
+    std::vector<std::pair<std::string, long long> > topRequested;
+    std::vector<std::pair<std::string, long long> > topExpired;
+  };
+
+  // shard_result - the part of the final report computed by one shard (or, once merged,
+  // by all of them)
+  struct shard_result
+  {
+    // startDate is the start date as the text report has always combined it (see
+    // log_reader::start in report.cpp), actualStartDate the date the Start line gives;
+    // both as days since 1970-01-01
+    int startDate;
+    int actualStartDate;
+    int daysSinceStart;
+    std::map<std::string, shard_food> foods;
+    std::map<std::string, shard_warehouse> warehouses;
+
+    // length of the top lists, 0 if the run kept none
+    int topK;
+
+    // diagnostics by the number of the log line they were printed for, each a line of
+    // output; a line every shard replays (a Transfer naming no warehouses) is reported by
+    // each of them, and kept once
+    std::map<long long, std::vector<std::string> > messages;
+
+    shard_result();
+
+    // merge - adds another shard's result into this one
+    void merge(const shard_result& other);
+
+    // write - saves the result to a file
+    // returns - false if the file could not be written
+    bool write(const std::string& fileName) const;
+
+    // read - loads a result saved by write
+    // returns - false if the file could not be read
+    bool read(const std::string& fileName);
+
+    // printMessages - writes the diagnostics to out in log order and flushes it
+    void printMessages(std::ostream& out) const;
+  };
+
+  // line_marker - reads a "Line: <n>" line of a shard log: n is the number (from 1) of the
+  // next line in the original log
+  // returns - false for any other line
+  bool line_marker(std::string_view line, long long& number);
+
+  // shard_of - returns the shard (0 .. count - 1) owning the named warehouse
+  int shard_of(std::string_view warehouseName, int count);
+
+  // split_log - writes the log out as count shard logs named <prefix><index>.log
+  // throws - std::out_of_range for a malformed line, like reading the log does; the shard
+  // logs then hold every line before it
+  // returns - false if the log or a shard log could not be opened or written, or a
+  // transfer moves stock between warehouses of different shards; the reason (with the
+  // number of the transfer's line) is printed on standard output
+  bool split_log(const std::string& fileName, int count, const std::string& prefix);
+
+  // run_shards - splits the log into a temporary directory, forks one worker process per
+  // shard and merges their results
+  // parameter - worker - run in each child process with the shard index, the shard log and
+  // the result file to write; returns the child's exit status
+  // parameter - merged - receives the merged result
+  // returns - false if splitting failed or any worker failed, after printing which; no
+  // worker is started once the split has failed
+  bool run_shards(const std::string& fileName, int count,
+		  const std::function<int(int, const std::string&, const std::string&)>& worker,
+		  shard_result& merged);
+}
+
+#endif
@@ -30,7 +30,15 @@ namespace reports
     this->head = NULL;
     this->tail = NULL;
 
-    shelf::constructor_calls++;
+    // the creating warehouse is the only holder
+    this->shares = 1;
+
+    // nothing on the shelf yet
+    this->total = 0;
+    this->lotCount = 0;
+    this->irregular = false;
+
+    shelf::constructor_calls.fetch_add(1, std::memory_order_relaxed);
   }
 
   // deconstructor - destroys a shelf and frees memory
@@ -38,7 +46,7 @@ namespace reports
   {
     // call clean helper
     this->clean();
-    shelf::destructor_calls++;
+    shelf::destructor_calls.fetch_add(1, std::memory_order_relaxed);
   }
 
   // receive - handles incoming shipment of the item this shelf contains
@@ -47,25 +55,42 @@ namespace reports
   // shipment
   // if the tail node does not exist, that means nothing has been put on the shelf yet
   // if the tail node does not exist, builds a new node which both head and tail point to
+  // a lot transferred in from another shelf (see transfer) can expire later than today's
+  // shipment, in which case the shipment is merged into the list by expiration date
   void shelf::receive(int qty, int currentDate)
   {
+    if (tail != NULL && tail->expireDate > currentDate + this->shelfLife)
+      {
+	node* lot = node::make(currentDate, this->shelfLife);
+	lot->quantity = qty;
+	merge(lot);
+	return;
+      }
+
     // if the tail exists and the current tail node does not represent the current date
     // make a new node as tail's next node, and point tail to it
     if (tail != NULL && currentDate != tail->expireDate - this->shelfLife)
       {
-	tail->next = new node(currentDate, this->shelfLife);
+	tail->next = node::make(currentDate, this->shelfLife);
 	tail = tail->next;
+	lotCount++;
       }
     // otherwise, if the tail does not exist, build a new node and point the head and tail
     // to it. No tail means there are no nodes in the linked list yet
     else if (tail == NULL)
       {
-	head = new node(currentDate, this->shelfLife);
+	head = node::make(currentDate, this->shelfLife);
 	tail = head;
+	lotCount++;
       }
 
-    // add the qty to tail's quantity
+    // add the qty to tail's quantity and the shelf's total
     tail->quantity += qty;
+    total += qty;
+
+    // a negative receive leaves a lot the bulk drain in request cannot reason about
+    if (qty < 0)
+      irregular = true;
   }
 
   // request - handles requests to send out a shipment of the item this shelf contains
@@ -73,8 +98,23 @@ namespace reports
   // until the requested quantity has been satisfied or the entire shelf has been emptied
   // out
   // parameter - qty - quantity of items to sent out
-  void shelf::request(int qty)
+  // returns - the quantity actually sent out
+  int shelf::request(int qty)
   {
+    // a request for at least everything on the shelf empties it, so instead of walking the
+    // list the whole chain is handed to the spare node list in one step
+    // (only valid while every lot is non negative, which the total alone cannot show)
+    if (head != NULL && qty >= total && !irregular)
+      {
+	int filled = (int)total;
+	node::recycle(head, tail, lotCount);
+	head = NULL;
+	tail = NULL;
+	total = 0;
+	lotCount = 0;
+	return filled;
+      }
+
     // remain_qty represents how much left of the order needs to be filled
     int remain_qty = qty;
 
@@ -85,9 +125,10 @@ namespace reports
 	// node's quantity. amountSubt is the smaller of the two values
 	int amountSubt = (remain_qty > head->quantity) ? head->quantity : remain_qty;
 
-	// subtract amountSub from the remain_qty and current node's quantity
+	// subtract amountSub from the remain_qty, current node's quantity and the total
 	remain_qty -= amountSubt;
 	head->quantity -= amountSubt;
+	total -= amountSubt;
 
 	// if the current node's quantity was exhausted, check the next node and delete
 	// the current node as it is no longer needed
@@ -99,20 +140,22 @@ namespace reports
 	    // when this happens, return as there is nothing left to do
 	    if (tail == head)
 	      {
-		delete head;
+		node::recycle(head, head, 1);
+		lotCount--;
 
 		head = tail;
 		tail = NULL;
 		head = NULL;
 
-		return;
+		return qty - remain_qty;
 	      }
-	    // point head to head's next node and delete the old head
+	    // point head to head's next node and recycle the old head
 	    else
 	      {
 		node* temp = head;
 		head = head->next;
-		delete temp;
+		node::recycle(temp, temp, 1);
+		lotCount--;
 	      }
 	  }
 
@@ -120,8 +163,96 @@ namespace reports
         // else to do
 	else
           {
-	    return;
+	    return qty - remain_qty;
+	  }
+      }
+    return qty - remain_qty;
+  }
+
+  // transfer - cuts lots off the head of the list until qty has been taken
+  // lots taken whole are unlinked as they are and keep their nodes; only a lot taken in
+  // part needs a new node, for the part that moves
+  int shelf::transfer(int qty, shelf& destination)
+  {
+    int remain_qty = qty;
+    node* first = NULL;
+    node* last = NULL;
+
+    while (head != NULL && remain_qty > 0)
+      {
+	// as in request, take the smaller of the lot and what is still wanted
+	int amountSubt = (remain_qty > head->quantity) ? head->quantity : remain_qty;
+	remain_qty -= amountSubt;
+	total -= amountSubt;
+
+	node* moving;
+	if (head->quantity == amountSubt)
+	  {
+	    moving = head;
+	    head = head->next;
+	    lotCount--;
+	    if (head == NULL)
+	      tail = NULL;
+	  }
+	else
+	  {
+	    head->quantity -= amountSubt;
+	    moving = node::make(0, 0);
+	    moving->expireDate = head->expireDate;
+	    moving->quantity = amountSubt;
 	  }
+
+	moving->next = NULL;
+	if (first == NULL)
+	  first = moving;
+	else
+	  last->next = moving;
+	last = moving;
+      }
+
+    if (first != NULL)
+      destination.merge(first);
+    return qty - remain_qty;
+  }
+
+  // merge - one pass over both lists, which are both in expiration date order
+  void shelf::merge(node* chain)
+  {
+    node* previous = NULL;
+    node* at = head;
+    while (chain != NULL)
+      {
+	node* lot = chain;
+	chain = chain->next;
+
+	while (at != NULL && at->expireDate < lot->expireDate)
+	  {
+	    previous = at;
+	    at = at->next;
+	  }
+
+	total += lot->quantity;
+	if (lot->quantity < 0)
+	  irregular = true;
+
+	// a lot with the same expiration date absorbs the incoming one
+	if (at != NULL && at->expireDate == lot->expireDate)
+	  {
+	    at->quantity += lot->quantity;
+	    node::recycle(lot, lot, 1);
+	    continue;
+	  }
+
+	// otherwise the incoming node is linked in before at
+	lot->next = at;
+	if (previous == NULL)
+	  head = lot;
+	else
+	  previous->next = lot;
+	if (at == NULL)
+	  tail = lot;
+	previous = lot;
+	lotCount++;
       }
   }
 
@@ -129,44 +260,95 @@ namespace reports
   // moves the head node pointer to the head node's next and deletes the old
   // head node
   // parameter - currentDate - int representing days since start date
-  void shelf::removeExpired(int currentDate)
+  // returns - the quantity removed
+  int shelf::removeExpired(int currentDate)
   {
+    int expired = 0;
+
     // Assuming the head exists and it's expiration date is equal to the current date...
     if (head != NULL && head->expireDate == currentDate)
       {
+	// the expired quantity leaves the total
+	expired = head->quantity;
+	total -= expired;
+
 	// if the tail and head point to the same node, need to reset the shelf
 	// this implies there was only one node remaining in the list, so tail
 	// must be modified as well
 	if (tail == head)
 	  {
-	    delete head;
+	    node::recycle(head, head, 1);
+	    lotCount--;
 	    head = tail;
 	    tail = NULL;
 	    head = NULL;
 	  }
-	// point head to head's next node and delete the old head
+	// point head to head's next node and recycle the old head
 	else
 	  {
 	    node* temp = head;
 	    head = head->next;
-	    delete temp;
+	    node::recycle(temp, temp, 1);
+	    lotCount--;
 	  }
       }
+    return expired;
   }
 
   // clean - helper for deconstructor
-  // steps through the list and deletes every node, then sets head and tail to null
+  // hands the whole list to the spare node list, then sets head and tail to null
   void shelf::clean()
   {
-    node *curr = head;
-    while(curr != NULL)
-      {
-	node *temp = curr;
-	curr = curr->next;
-	delete temp;
-      }
+    if (head != NULL)
+      node::recycle(head, tail, lotCount);
     head = NULL;
     tail = NULL;
+    total = 0;
+    lotCount = 0;
+  }
+
+  // copy - builds a new shelf with the same shelf life and a node for node copy of the list
+  shelf* shelf::copy() const
+  {
+    shelf* result = new shelf(this->shelfLife);
+    for (node *curr = head; curr != NULL; curr = curr->next)
+      {
+	node* added = node::make(0, 0);
+	added->expireDate = curr->expireDate;
+	added->quantity = curr->quantity;
+
+	if (result->tail == NULL)
+	  result->head = added;
+	else
+	  result->tail->next = added;
+	result->tail = added;
+      }
+    result->total = total;
+    result->lotCount = lotCount;
+    result->irregular = irregular;
+    return result;
+  }
+
+  // reset - any nodes left go back to the spare list, then the fields start over
+  void shelf::reset(int life)
+  {
+    clean();
+    this->shelfLife = life;
+    this->irregular = false;
+    this->shares.store(1, std::memory_order_relaxed);
+  }
+
+  // expiresOn - checks the same condition as removeExpired without changing anything
+  bool shelf::expiresOn(int currentDate) const
+  {
+    return head != NULL && head->expireDate == currentDate;
+  }
+
+  // lots - steps through the list copying out each node's expiration date and quantity
+  void shelf::lots(std::vector<std::pair<int, int> >& out) const
+  {
+    for (node *curr = head; curr != NULL; curr = curr->next)
+      out.push_back(std::make_pair(curr->expireDate, curr->quantity));
   }
   /*
   // tester which displays the whole contents of the shelf
@@ -183,8 +365,8 @@ namespace reports
   }
 */
   // Methods and data for auditing purposes, copied from homework 3
-  long long shelf::constructor_calls = 0;
-  long long shelf::destructor_calls = 0;
+  std::atomic<long long> shelf::constructor_calls(0);
+  std::atomic<long long> shelf::destructor_calls(0);
 
   // Returns value of constructor_calls
   long long shelf::constructor_count()
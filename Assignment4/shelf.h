@@ -26,6 +26,9 @@
 #define SHELF_H
 
 #include "node.h"
+#include <atomic>
+#include <utility>
+#include <vector>
 
 namespace reports
 {
@@ -57,19 +60,51 @@ namespace reports
     // request - handles requests to send out a shipment of the item this shelf contains
     // this method will step through as many nodes as it can from head to tail until
     // either the order is satisfied or the shelf has been emptied
+    // a request for at least the shelf's total releases every node at once, in constant
+    // time while the thread's spare node list has room for them; past node::spare_limit
+    // the nodes are deleted one at a time, so such a drain costs O(lots), the same as
+    // the receives which built them (./benchmark drain shows both)
     // parameter - qty - quantity of items to send out
-    void request(int qty);
+    // returns - the quantity actually sent out (less than qty if the shelf ran out)
+    int request(int qty);
+
+    // transfer - moves the oldest lots to another shelf, keeping their expiration dates
+    // lots are taken the way request takes them; whole lots are moved node and all, and
+    // a lot taken in part is split
+    // parameter - qty - quantity to move
+    // parameter - destination - the receiving shelf (of another warehouse)
+    // returns - the quantity moved (less than qty if the shelf ran out)
+    int transfer(int qty, shelf& destination);
+
+    // merge - links a chain of lots (in expiration date order) into the list by expiration
+    // date; a lot whose date is already on the shelf is added to that node
+    void merge(node* chain);
 
     // advanceDay - checks to see if the goods in the head node have expired. If so, 
     // moves the head node pointer to the head node's next and deletes the old
     // head node
     // parameter - currentDate - int representing days since start date which will be
     // check against the node's expiration date
-    void removeExpired(int currentDate);
+    // returns - the quantity removed, 0 if nothing expired
+    int removeExpired(int currentDate);
 
     // clean - helper method for deconstructor
     void clean();
 
+    // lots - appends the (expireDate, quantity) pair of every node, head to tail
+    void lots(std::vector<std::pair<int, int> >& out) const;
+
+    // copy - builds an unshared shelf holding copies of every node
+    shelf* copy() const;
+
+    // reset - readies an empty shelf kept by a warehouse (see warehouse::makeShelf) for
+    // another product, as if it had just been built
+    // parameter - life - the shelf life of the new product
+    void reset(int life);
+
+    // expiresOn - returns true if removeExpired(currentDate) would remove the head node
+    bool expiresOn(int currentDate) const;
+
     // DIAGNOSTICS - tester
     void DIAGNOSTICS();
 
@@ -80,13 +115,29 @@ namespace reports
     // int representing the shelfLife of the product this shelf contains
     int shelfLife;
 
+    // total quantity over all nodes, kept up to date by every change
+    // long long since many int lots can add up past an int
+    long long total;
+
+    // number of nodes in the list, so the whole list can go back to the spare list in
+    // one step without walking it (see node::recycle)
+    long long lotCount;
+
+    // true once a negative quantity was received; the bulk drain in request is only
+    // valid while every node's quantity is non negative
+    bool irregular;
+
+    // number of warehouses holding this shelf, see warehouse::fork
+    // a shelf is only ever modified while it has a single holder
+    std::atomic<int> shares;
+
   public:
     static long long constructor_count ();
     static long long destructor_count ();
 
   private:
-    static long long constructor_calls;
-    static long long destructor_calls;
+    static std::atomic<long long> constructor_calls;
+    static std::atomic<long long> destructor_calls;
   };
 }
 
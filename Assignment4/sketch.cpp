@@ -0,0 +1,159 @@
+//----------------------------------------------
+// sketch.cpp
+//
+// class function definitions for heavy_hitters
+// a more detailed description can be found in sketch.h
+//----------------------------------------------
+
+#include "sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace reports
+{
+  // constructor - the width is rounded up to a power of two so a cell is a mask away
+  heavy_hitters::heavy_hitters(const sketch_config& config)
+    : used(0), smallestSlot(0), sum(0)
+  {
+    double epsilon = config.epsilon > 0 ? config.epsilon : 0.001;
+    double delta = config.delta > 0 && config.delta < 1 ? config.delta : 0.01;
+
+    std::size_t width = 16;
+    while ((double)width < std::exp(1.0) / epsilon && width < ((std::size_t)1 << 26))
+      width *= 2;
+    mask = width - 1;
+
+    depth = (int)std::ceil(std::log(1.0 / delta));
+    if (depth < 1)
+      depth = 1;
+    if (depth > 16)
+      depth = 16;
+    counters.assign(width * depth, 0);
+
+    int k = config.k > 0 ? config.k : 1;
+    slotKeys.assign(k, 0);
+    slotCounts.assign(k, 0);
+    slotCodes.resize(k);
+  }
+
+  // add - one hash, a counter per row (keeping the smallest, the new estimate), then the
+  // slot scan
+  void heavy_hitters::add(std::string_view upc, long long quantity)
+  {
+    if (quantity < 1)
+      return;
+    sum += quantity;
+
+    std::uint64_t key = hash(upc);
+    std::uint32_t smallest = 0xffffffffu;
+    for (int row = 0; row < depth; row++)
+      {
+	std::uint32_t& counter = counters[cell(key, row)];
+	counter = (std::uint64_t)counter + quantity > 0xffffffffu ? 0xffffffffu : counter + (std::uint32_t)quantity;
+	smallest = std::min(smallest, counter);
+      }
+
+    for (int i = 0; i < used; i++)
+      if (slotKeys[i] == key)
+	{
+	  slotCounts[i] += quantity;
+	  if (i == smallestSlot)
+	    findSmallest();
+	  return;
+	}
+
+    // a free slot, or the one with the smallest count if the code's estimate is above it
+    int slot = used;
+    if (used < (int)slotKeys.size())
+      used++;
+    else if (smallest > slotCounts[smallestSlot])
+      slot = smallestSlot;
+    else
+      return;
+    slotKeys[slot] = key;
+    slotCounts[slot] = smallest;
+    slotCodes[slot].assign(upc.data(), upc.size());
+    findSmallest();
+  }
+
+  // findSmallest - a scan of the k counts
+  void heavy_hitters::findSmallest()
+  {
+    smallestSlot = 0;
+    for (int i = 1; i < used; i++)
+      if (slotCounts[i] < slotCounts[smallestSlot])
+	smallestSlot = i;
+  }
+
+  // estimate - the smallest counter of the code's cells
+  long long heavy_hitters::estimate(std::string_view upc) const
+  {
+    std::uint64_t key = hash(upc);
+    std::uint32_t smallest = counters[cell(key, 0)];
+    for (int row = 1; row < depth; row++)
+      smallest = std::min(smallest, counters[cell(key, row)]);
+    return smallest;
+  }
+
+  // top - both estimates overcount, so the smaller is kept
+  void heavy_hitters::top(std::vector<std::pair<std::string, long long> >& out) const
+  {
+    std::size_t first = out.size();
+    for (int i = 0; i < used; i++)
+      out.push_back(std::make_pair(slotCodes[i], std::min(slotCounts[i], estimate(slotCodes[i]))));
+
+    std::sort(out.begin() + first, out.end(),
+	      [](const std::pair<std::string, long long>& a, const std::pair<std::string, long long>& b)
+	      {
+		if (a.second != b.second)
+		  return a.second > b.second;
+		return a.first < b.first;
+	      });
+  }
+
+  long long heavy_hitters::total() const
+  {
+    return sum;
+  }
+
+  std::size_t heavy_hitters::bytes() const
+  {
+    std::size_t result = counters.size() * sizeof(std::uint32_t)
+      + slotKeys.size() * (sizeof(std::uint64_t) + sizeof(long long) + sizeof(std::string));
+    for (std::size_t i = 0; i < slotCodes.size(); i++)
+      if (slotCodes[i].capacity() > 15)
+	result += slotCodes[i].capacity();
+    return result;
+  }
+
+  // hash - eight bytes at a time, each word mixed in with a multiply and shift (the
+  // splitmix64 finalizer), so a 10 digit code costs two multiplies rather than ten
+  std::uint64_t heavy_hitters::hash(std::string_view upc)
+  {
+    std::uint64_t value = 0x9E3779B97F4A7C15ull * (upc.size() + 1);
+    std::size_t at = 0;
+    for (;;)
+      {
+	std::uint64_t word = 0;
+	std::size_t length = upc.size() - at < 8 ? upc.size() - at : 8;
+	std::memcpy(&word, upc.data() + at, length);
+	value = (value ^ word) * 0xBF58476D1CE4E5B9ull;
+	value ^= value >> 31;
+	at += length;
+	if (at >= upc.size())
+	  break;
+      }
+    value *= 0x94D049BB133111EBull;
+    return value ^ (value >> 29);
+  }
+
+  // cell - row i uses h1 + i * h2, with h2 odd so the rows differ
+  std::size_t heavy_hitters::cell(std::uint64_t key, int row) const
+  {
+    std::uint32_t h1 = (std::uint32_t)key;
+    std::uint32_t h2 = (std::uint32_t)(key >> 32) | 1;
+    return (std::size_t)row * (mask + 1) + ((h1 + (std::size_t)row * h2) & mask);
+  }
+}
@@ -0,0 +1,105 @@
+//--------------------------------------------
+// sketch.h
+//
+// header for the heavy_hitters class
+// a heavy_hitters sketch finds the UPC codes with the largest totals in a stream of
+// (upc, quantity) updates in fixed memory, however many products the stream holds; a
+// warehouse keeps one for requested and one for expired quantities (see
+// warehouse::trackHeavyHitters)
+//
+// it is two sketches updated together:
+// - a Count-Min sketch: depth rows of width counters; an update adds to one counter per
+//   row, an estimate is the smallest of them. It never underestimates, and with
+//   probability 1 - delta overestimates by at most epsilon * (total of all updates) for
+//   width >= e / epsilon and depth >= ln(1 / delta)
+// - a Space-Saving summary of k slots: a UPC code in a slot adds to its count; any other
+//   takes over the slot with the smallest count, starting from its Count-Min estimate.
+//   Plain Space-Saving replaces the smallest slot on every miss, which on a long tail of
+//   products means nearly every update; here a code only takes it over once its estimate
+//   is above that count, so the slots settle on the heavy hitters. The smallest count
+//   still never goes down, so as in Space-Saving every code whose total is above it
+//   holds a slot, and every count is an overestimate
+// the top list is the k slots, each with the smaller of its two estimates
+//
+// an update hashes the code once (a word at a time), adds to depth counters and scans k
+// slot keys; the slot a miss would take over is kept, so a miss that is not admitted
+// costs one comparison. The default sizes (k = 10, 5 rows of 4096 counters, 80k per
+// sketch) fit in the second level cache
+//--------------------------------------------
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace reports
+{
+  // sketch_config - the size of a heavy_hitters sketch
+  struct sketch_config
+  {
+    // length of the top list
+    int k;
+
+    // Count-Min error as a fraction of the total, and the chance of exceeding it
+    double epsilon;
+    double delta;
+
+    sketch_config() : k(10), epsilon(0.001), delta(0.01)
+    {
+    }
+  };
+
+  class heavy_hitters
+  {
+  public:
+    explicit heavy_hitters(const sketch_config& config);
+
+    // add - counts quantity more of a UPC code; quantities below 1 are ignored
+    void add(std::string_view upc, long long quantity);
+
+    // estimate - returns the Count-Min estimate of a UPC code's total
+    long long estimate(std::string_view upc) const;
+
+    // top - fills out with the UPC codes of the top list and their estimates, largest
+    // first (equal estimates in UPC order)
+    void top(std::vector<std::pair<std::string, long long> >& out) const;
+
+    // total - returns the sum of every quantity added
+    long long total() const;
+
+    // bytes - returns the memory held by the counters and slots
+    std::size_t bytes() const;
+
+  private:
+    // hash - of the code, mixed so both halves can index rows
+    static std::uint64_t hash(std::string_view upc);
+
+    // findSmallest - points smallestSlot at the slot with the smallest count
+    void findSmallest();
+
+    // cell - the counter of row for a hash, by double hashing (one hash, every row)
+    std::size_t cell(std::uint64_t key, int row) const;
+
+    // Count-Min counters, row after row; they saturate rather than wrap
+    int depth;
+    std::size_t mask;
+    std::vector<std::uint32_t> counters;
+
+    // Space-Saving slots: keys and counts apart so the scans read only what they compare
+    std::vector<std::uint64_t> slotKeys;
+    std::vector<long long> slotCounts;
+    std::vector<std::string> slotCodes;
+    int used;
+
+    // the slot a new code would take over; kept so a miss costs one comparison
+    int smallestSlot;
+
+    long long sum;
+  };
+}
+
+#endif
@@ -14,6 +14,7 @@
 
 #include <iostream>
 #include "warehouse.h"
+#include "sketch.h"
 
 namespace reports
 {
@@ -24,19 +25,34 @@ namespace reports
       busiestDay = 0;
       highestTransactionsToDate = 0;
       currentDayTransactions = 0;
+      requestedQuantity = 0;
+      filledQuantity = 0;
+      changed = NULL;
+      shelvesCreated = 0;
+      shelvesReused = 0;
+      shelvesReclaimed = 0;
+      reclaiming = true;
+      requestedTop = NULL;
+      expiredTop = NULL;
 
       // Instantiate shelfMap for quick lookup of shelves based on upc codes
       shelfMap = new std::map<std::string, shelf*>();
 
       // Increment constructor calls
-      warehouse::constructor_calls++;
+      warehouse::constructor_calls.fetch_add(1, std::memory_order_relaxed);
     }
 
   // Destructor - destroys warehouse object and frees memory
   warehouse::~warehouse()
     {
-      warehouse::destructor_calls++;
+      warehouse::destructor_calls.fetch_add(1, std::memory_order_relaxed);
       clean();
+      delete shelfMap;
+      delete changed;
+      for (std::size_t i = 0; i < spareShelves.size(); i++)
+	delete spareShelves[i];
+      delete requestedTop;
+      delete expiredTop;
     }
     
   // receiveToShelf - handles incoming receive of a certain product
@@ -47,33 +63,30 @@ namespace reports
   // used if shelf doesn't exist yet)
   void warehouse::receiveToShelf(std::string upc_code, int qty, int currentDate, int shelfLife)
     {
-      // map->at throws an exception if the key doesn't exist, so if found, do the following:
-      try
-	{
-	  // acquire the appropriate shelf from the shelf table
-	  shelf *curr = shelfMap->at(upc_code);
-
-	  // pass the receive command to the shelf
-	  curr->receive(qty, currentDate);
+      std::map<std::string, shelf*>::iterator found = shelfMap->find(upc_code);
+      shelf *curr;
 
-	  // in addition, add the quantity to current day's transactions
-	  currentDayTransactions += qty;
+      // if found, acquire the appropriate shelf from the shelf table (copying it first if
+      // it is shared with a fork)
+      if (found != shelfMap->end())
+	{
+	  curr = writable(found);
 	}
-      // otherwise, the key doesn't exist yet, so a new shelf must be made
-      catch(std::exception e)
+      // otherwise, the key doesn't exist yet, so a new shelf must be made and added to the
+      // shelf map
+      else
 	{
-	  // make a new shelf
-	  shelf *curr = new shelf(shelfLife);
-
-	  // add the shelf to the shelf map
+	  curr = makeShelf(shelfLife);
 	  shelfMap->insert(std::pair<std::string, shelf*>(upc_code, curr));
+	}
 
-	  // pass the receive command to the shelf
-	  curr->receive(qty, currentDate);
+      // pass the receive command to the shelf
+      curr->receive(qty, currentDate);
+      if (changed != NULL)
+	changed->insert(upc_code);
 
-	  // in addition, add the quantity to the current day's transactions
-	  currentDayTransactions += qty;
-	}
+      // in addition, add the quantity to current day's transactions
+      currentDayTransactions += qty;
     }
 
   // requestToShelf - handles incoming requests for a certain product
@@ -81,31 +94,78 @@ namespace reports
   // parameter - qty - quantity of product requested
   void warehouse::requestToShelf(std::string upc_code, int qty)
   {
-    // map->at throws an exception if the key doesn't exist, so if found, do the following:
-    try
+    // the quantity counts towards the day's transactions whether or not there is a shelf
+    currentDayTransactions += qty;
+    requestedQuantity += qty;
+    if (requestedTop != NULL)
+      requestedTop->add(upc_code, qty);
+
+    // with no shelf nothing is sent out and the whole request is short
+    std::map<std::string, shelf*>::iterator found = shelfMap->find(upc_code);
+    if (found == shelfMap->end())
+      return;
+
+    // pass the request to the appropriate shelf
+    shelf *curr = writable(found);
+    filledQuantity += curr->request(qty);
+    if (changed != NULL)
+      changed->insert(upc_code);
+
+    // if there is no more contents in the shelf, remove it from the map and delete the shelf
+    if (curr->head == NULL)
       {
-	// find the appropriate shelf associated with the upc code
-        shelf *curr = shelfMap->at(upc_code);
+	release(curr);
+	shelfMap->erase(found);
+      }
+  }
 
-	// pass the request to the shelf
-        curr->request(qty);
+  // transferToShelf - one lookup on each side, then the shelves move the lots themselves
+  // parameter - upc_code - upc code of the product to move
+  // parameter - qty - quantity to move
+  // parameter - destination - the receiving warehouse
+  int warehouse::transferToShelf(std::string upc_code, int qty, warehouse& destination)
+  {
+    if (&destination == this || qty <= 0)
+      return 0;
 
-	// add the quantity to the day's transactions
-        currentDayTransactions += qty;
-	
-	// if there is no more contents in the shelf, remove it from the map and delete the shelf
-	if (!isStocked(upc_code))
-	  {
-	    delete curr;
-	    // Note to test
-	    shelfMap->erase(upc_code);
-	  }
+    currentDayTransactions += qty;
+
+    std::map<std::string, shelf*>::iterator found = shelfMap->find(upc_code);
+    if (found == shelfMap->end())
+      return 0;
+    shelf *from = writable(found);
+
+    std::map<std::string, shelf*>::iterator receiving = destination.shelfMap->find(upc_code);
+    shelf *to;
+    if (receiving != destination.shelfMap->end())
+      to = destination.writable(receiving);
+    else
+      {
+	to = destination.makeShelf(from->shelfLife);
+	destination.shelfMap->insert(std::pair<std::string, shelf*>(upc_code, to));
+      }
+
+    int moved = from->transfer(qty, *to);
+    destination.currentDayTransactions += moved;
+
+    if (changed != NULL)
+      changed->insert(upc_code);
+    if (destination.changed != NULL)
+      destination.changed->insert(upc_code);
+
+    // as with a request, a shelf emptied by the move is removed
+    if (from->head == NULL)
+      {
+	release(from);
+	shelfMap->erase(found);
       }
-    // no shelf is found in this case, so just add to the transactions
-    catch(std::exception e)
+    // and a shelf created for nothing is not kept
+    if (to->head == NULL)
       {
-        currentDayTransactions += qty;
+	destination.shelfMap->erase(upc_code);
+	destination.release(to);
       }
+    return moved;
   }
 
   // advanceDay - handles removal of all expired products and calculates if the current
@@ -115,22 +175,42 @@ namespace reports
     // define an iterator to iterate through all of the shelves in the map
     typedef std::map<std::string, shelf*>::iterator walkThrough;
     // iterate through all keys, checking to for expired goods on all shelves
-    for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
+    // the iterator is only advanced here or by erase, which returns the next one
+    for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); )
       {	 
-	// remove expired products from the shelf if any
 	shelf *curr = iterator->second;
-        curr->removeExpired(dayVal);
+	if (!curr->expiresOn(dayVal))
+	  {
+	    ++iterator;
+	    continue;
+	  }
+	if (changed != NULL)
+	  changed->insert(iterator->first);
 
-	// if removal of expired objects from the shelf resulted in it being empty
-	// delete the shelf and remove it from the shelf map
+	// if removal of expired objects from the shelf would leave it empty, release the
+	// shelf and remove it from the shelf map; a shelf shared with a fork is not even
+	// copied first, and an unshared one is emptied so release can keep it
 	// note: map.erase does in fact destroy the item in the value
 	// but since this is a map of pointers, only the pointer is removed,
-	// so the object must also be deleted
-	/*if (!isStocked(iterator->first))
+	// so the object must also be released
+	if (curr->head == curr->tail && reclaiming)
 	  {
-	    //--INCOMPLETE--//
-	    delete iterator->second;
-	    }*/
+	    if (expiredTop != NULL)
+	      expiredTop->add(iterator->first, curr->total);
+	    if (curr->shares.load(std::memory_order_acquire) == 1)
+	      curr->removeExpired(dayVal);
+	    release(curr);
+	    iterator = shelfMap->erase(iterator);
+	    shelvesReclaimed++;
+	    continue;
+	  }
+
+	// otherwise remove expired products from the shelf
+	// shelves shared with a fork are only copied if something on them expires
+	int expired = writable(iterator)->removeExpired(dayVal);
+	if (expiredTop != NULL)
+	  expiredTop->add(iterator->first, expired);
+	++iterator;
       }
     // now check if the total transactions on the current day exceed or is equivalent
     // to the previous highest transactions, if so update the busiest day and
@@ -149,24 +229,22 @@ namespace reports
   // returns - true if stocked, false if not
   bool warehouse::isStocked(std::string upc_code)
   {
-    // since map.at throws an exception if the key is not found, do the following if found:
-    try
-      {
-        shelf *curr = shelfMap->at(upc_code);
+    // not finding the key implies the shelf doesn't exist; a lookup that misses is the
+    // common case in a report, so it is a find rather than a throwing map.at
+    std::map<std::string, shelf*>::iterator found = shelfMap->find(upc_code);
+    if (found == shelfMap->end())
+      return false;
 
-	// note, this part should probably always be reached if the shelf exists
-        if(curr->head != NULL)
-          return true;
+    // note, a shelf in the map should always have a head
+    return found->second->head != NULL;
+  }
 
-	// this should probably never be reached
-        else
-          return false;
-      }
-    // not finding the key implies the shelf doesn't exist, so return false
-    catch(std::exception e)
-      {
-        return false;
-      }
+  // stockedCodes - one walk of the shelf map
+  void warehouse::stockedCodes(std::vector<std::string_view>& out)
+  {
+    for (std::map<std::string, shelf*>::iterator iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
+      if (iterator->second->head != NULL)
+	out.push_back(iterator->first);
   }
 
   // getBusiestDay - returns an int representing the busiest day as days since the start date
@@ -181,21 +259,195 @@ namespace reports
     return highestTransactionsToDate;
   }
 
+  // getCurrentTransactions - returns an int representing transactions so far today
+  int warehouse::getCurrentTransactions()
+  {
+    return currentDayTransactions;
+  }
+
+  // onHand - the shelf keeps its own total, so no lots are walked
+  long long warehouse::onHand(std::string upc_code)
+  {
+    std::map<std::string, shelf*>::iterator found = shelfMap->find(upc_code);
+    if (found == shelfMap->end())
+      return 0;
+    return found->second->total;
+  }
+
+  // getRequested - returns the total quantity requested
+  long long warehouse::getRequested()
+  {
+    return requestedQuantity;
+  }
+
+  // getShortfall - returns the requested quantity which was not sent out
+  long long warehouse::getShortfall()
+  {
+    return requestedQuantity - filledQuantity;
+  }
+
+  // getFillRate - returns the sent out quantity as a fraction of the requested quantity
+  double warehouse::getFillRate()
+  {
+    if (requestedQuantity == 0)
+      return 1.0;
+    return (double)filledQuantity / (double)requestedQuantity;
+  }
+
+  // contents - copies out the lots of every shelf which still holds a node
+  void warehouse::contents(std::map<std::string, std::vector<std::pair<int, int> > >& out)
+  {
+    typedef std::map<std::string, shelf*>::iterator walkThrough;
+    for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
+      {
+	if (iterator->second->head != NULL)
+	  iterator->second->lots(out[iterator->first]);
+      }
+  }
+
   void warehouse::clean()
   {
     typedef std::map<std::string, shelf*>::iterator walkThrough;
     for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
       {	 
-	delete iterator->second;
+	release(iterator->second);
       }
     shelfMap->clear();
   }
 
+  // trackHeavyHitters - starts both sketches, once
+  void warehouse::trackHeavyHitters(const sketch_config& config)
+  {
+    if (requestedTop != NULL)
+      return;
+    requestedTop = new heavy_hitters(config);
+    expiredTop = new heavy_hitters(config);
+  }
+
+  // getTopRequested - NULL until trackHeavyHitters
+  const heavy_hitters* warehouse::getTopRequested()
+  {
+    return requestedTop;
+  }
+
+  // getTopExpired - NULL until trackHeavyHitters
+  const heavy_hitters* warehouse::getTopExpired()
+  {
+    return expiredTop;
+  }
+
+  // shelfStats - live and dead shelves are counted now, the rest is kept as it happens
+  shelf_stats warehouse::shelfStats()
+  {
+    shelf_stats result;
+    result.live = 0;
+    result.dead = 0;
+    typedef std::map<std::string, shelf*>::iterator walkThrough;
+    for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
+      {
+	if (iterator->second->head != NULL)
+	  result.live++;
+	else
+	  result.dead++;
+      }
+    result.spare = (long long)spareShelves.size();
+    result.created = shelvesCreated;
+    result.reused = shelvesReused;
+    result.reclaimed = shelvesReclaimed;
+    return result;
+  }
+
+  // makeShelf - the most recently emptied shelf first, its memory is the likeliest cached
+  shelf* warehouse::makeShelf(int shelfLife)
+  {
+    if (spareShelves.empty())
+      {
+	shelvesCreated++;
+	return new shelf(shelfLife);
+      }
+    shelf* curr = spareShelves.back();
+    spareShelves.pop_back();
+    curr->reset(shelfLife);
+    shelvesReused++;
+    return curr;
+  }
+
+  // fork - copies the map and the day's history, then marks every shelf as shared
+  warehouse* warehouse::fork()
+  {
+    warehouse* result = new warehouse();
+    result->busiestDay = busiestDay;
+    result->highestTransactionsToDate = highestTransactionsToDate;
+    result->currentDayTransactions = currentDayTransactions;
+    result->requestedQuantity = requestedQuantity;
+    result->filledQuantity = filledQuantity;
+    *result->shelfMap = *shelfMap;
+    if (requestedTop != NULL)
+      result->requestedTop = new heavy_hitters(*requestedTop);
+    if (expiredTop != NULL)
+      result->expiredTop = new heavy_hitters(*expiredTop);
+
+    typedef std::map<std::string, shelf*>::iterator walkThrough;
+    for(walkThrough iterator = shelfMap->begin(); iterator != shelfMap->end(); ++iterator)
+      {
+	iterator->second->shares.fetch_add(1, std::memory_order_relaxed);
+      }
+    return result;
+  }
+
+  // keepEmptyShelves - advanceDay then only empties the shelves, as removeExpired does
+  void warehouse::keepEmptyShelves()
+  {
+    reclaiming = false;
+  }
+
+  // trackChanges - starts the change set, once
+  void warehouse::trackChanges()
+  {
+    if (changed == NULL)
+      changed = new std::set<std::string>();
+  }
+
+  // takeChanges - hands over the change set in upc order and empties it
+  void warehouse::takeChanges(std::vector<std::string>& out)
+  {
+    if (changed == NULL)
+      return;
+    out.insert(out.end(), changed->begin(), changed->end());
+    changed->clear();
+  }
+
+  // writable - a shelf held by more than one warehouse is replaced by a private copy, and
+  // this warehouse's hold on the shared one is dropped
+  shelf* warehouse::writable(std::map<std::string, shelf*>::iterator iterator)
+  {
+    shelf* curr = iterator->second;
+    if (curr->shares.load(std::memory_order_acquire) == 1)
+      return curr;
+
+    shelf* copied = curr->copy();
+    release(curr);
+    iterator->second = copied;
+    return copied;
+  }
+
+  // release - the last holder keeps an empty shelf for makeShelf and deletes any other
+  // (a shelf released by clean, still holding stock, is not worth emptying)
+  void warehouse::release(shelf* curr)
+  {
+    if (curr->shares.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    if (curr->head == NULL && spareShelves.size() < spare_limit)
+      spareShelves.push_back(curr);
+    else
+      delete curr;
+  }
+
   //--- Auditing ---///
 
   // Methods and data for auditing purposes, copied from homework 3
-  long long warehouse::constructor_calls = 0;
-  long long warehouse::destructor_calls = 0;
+  std::atomic<long long> warehouse::constructor_calls(0);
+  std::atomic<long long> warehouse::destructor_calls(0);
 
   // Returns value of constructor_calls
   long long warehouse::constructor_count()
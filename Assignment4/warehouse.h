@@ -15,16 +15,42 @@
 #ifndef WAREHOUSE_H
 #define WAREHOUSE_H
 
+#include <atomic>
 #include <iostream>
 #include "shelf.h"
 #include <string>
 #include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 namespace reports
 {
   // Forward declaration of shelf class
   class shelf;
 
+  // the top requested and expired products, see sketch.h
+  class heavy_hitters;
+  struct sketch_config;
+
+  // shelf_stats - what happened to a warehouse's shelf objects, see warehouse::shelfStats
+  struct shelf_stats
+  {
+    // shelves in the map holding stock, and holding nothing (always 0 now that emptied
+    // shelves are removed, counted to keep it that way)
+    long long live;
+    long long dead;
+
+    // emptied shelves kept for reuse
+    long long spare;
+
+    // shelves built with new, taken from the spare list instead, and removed from the
+    // map by advanceDay because everything on them expired
+    long long created;
+    long long reused;
+    long long reclaimed;
+  };
+
   class warehouse
   {
   public:
@@ -47,19 +73,89 @@ namespace reports
     // parameter - qty - amount of product requested
     void requestToShelf(std::string upc_code, int qty);
 
+    // transferToShelf - moves the oldest lots of a product to another warehouse, keeping
+    // their expiration dates; the destination's shelf is created (with the shelf life of
+    // this one) if it has none
+    // the quantity counts towards this warehouse's transactions as a request would, and
+    // the quantity moved towards the destination's as a receive would
+    // parameter - upc_code - upc_code of the product to move
+    // parameter - qty - quantity to move
+    // parameter - destination - the receiving warehouse; moving to itself does nothing
+    // returns - the quantity moved (less than qty if the shelf ran out)
+    int transferToShelf(std::string upc_code, int qty, warehouse& destination);
+
     // advanceDay - handles removal of all expired products and calculates if the current
     // day's transactions exceed the previous maximum
+    // a shelf left empty is removed from the map, as a request emptying it would
     void advanceDay(int dayVal);
 
     // isStocked - checks if a certain product is stocked in the warehouse
     // returns - true if stocked, false if not
     bool isStocked(std::string upc_code);
 
+    // stockedCodes - appends the upc code of every stocked product, in upc order
+    // the codes point into the warehouse and are valid until it next changes
+    void stockedCodes(std::vector<std::string_view>& out);
+
     // getBusiestDay - returns an int representing the busiest day as days since start date
     int getBusiestDay();
 
     // getHighestTransactions - returns an int representing max transactions since start date
     int getHighestTransactions();
+
+    // getCurrentTransactions - returns an int representing transactions so far today
+    int getCurrentTransactions();
+
+    // onHand - returns the total quantity of a product on its shelf, 0 if there is none
+    long long onHand(std::string upc_code);
+
+    // getRequested - returns the total quantity requested since the warehouse was built
+    long long getRequested();
+
+    // getShortfall - returns the part of the requested quantity which could not be sent out
+    // because the shelf ran out (or never existed)
+    long long getShortfall();
+
+    // getFillRate - returns the fraction of the requested quantity which was sent out, 1 if
+    // nothing was requested yet
+    double getFillRate();
+
+    // contents - fills out with the lots of every stocked shelf as (expireDate, quantity)
+    // pairs, oldest first, keyed by upc code
+    // used to compare the full state of two warehouses
+    void contents(std::map<std::string, std::vector<std::pair<int, int> > >& out);
+
+    // fork - returns a new warehouse with the same shelves and busiest day history
+    // the shelves are shared rather than copied: whichever warehouse next changes a shared
+    // shelf takes a private copy of it first (copy on write), so a fork costs one map copy
+    // and each side then pays only for the shelves it changes
+    // the two warehouses may be used from different threads afterwards
+    warehouse* fork();
+
+    // trackChanges - from now on, remember the upc code of every shelf whose quantity may
+    // have changed (used by inventory_history, history.h)
+    void trackChanges();
+
+    // takeChanges - moves the upc codes remembered since the last call into out
+    void takeChanges(std::vector<std::string>& out);
+
+    // trackHeavyHitters - from now on, feed every requested quantity and every expired
+    // lot into a heavy_hitters sketch of the given size (fixed memory whatever the number
+    // of products); forks get copies of the sketches
+    void trackHeavyHitters(const sketch_config& config);
+
+    // getTopRequested, getTopExpired - return the sketches, NULL unless trackHeavyHitters
+    // was called
+    const heavy_hitters* getTopRequested();
+    const heavy_hitters* getTopExpired();
+
+    // keepEmptyShelves - from now on, leave shelves emptied by expiry in the map as they
+    // were before advanceDay reclaimed them (only for ./benchmark horizon to compare with)
+    void keepEmptyShelves();
+
+    // shelfStats - counts the shelves in the map and returns them with the spare list
+    // figures; walks the whole map
+    shelf_stats shelfStats();
   private:
     // map object which will map upc_codes to shelf pointers for fast access to certain
     // product shelves
@@ -67,6 +163,28 @@ namespace reports
 
     void clean();
 
+    // writable - returns the shelf at iterator, first replacing it with a private copy if
+    // it is shared with a fork
+    shelf* writable(std::map<std::string, shelf*>::iterator iterator);
+
+    // makeShelf - returns an empty shelf for a product, from the spare list if it has one
+    shelf* makeShelf(int shelfLife);
+
+    // release - drops this warehouse's hold on a shelf; if it was the last, an empty shelf
+    // goes to the spare list (while it is short of spare_limit) and any other is deleted
+    void release(shelf* curr);
+
+    // emptied shelves waiting for makeShelf, at most spare_limit of them
+    // each warehouse has its own, so forks used on other threads never share one
+    static const std::size_t spare_limit = 4096;
+    std::vector<shelf*> spareShelves;
+    long long shelvesCreated;
+    long long shelvesReused;
+    long long shelvesReclaimed;
+
+    // false once keepEmptyShelves was called
+    bool reclaiming;
+
     // int representing the busiest day for the warehouse as days since start date
     int busiestDay;
 
@@ -76,6 +194,18 @@ namespace reports
     // int representing the current day's total transactions
     int currentDayTransactions;
 
+    // running totals of the quantity requested and the quantity actually sent out
+    long long requestedQuantity;
+    long long filledQuantity;
+
+    // upc codes changed since the last takeChanges, NULL unless trackChanges was called
+    std::set<std::string> *changed;
+
+    // requested and expired quantities by upc code, NULL unless trackHeavyHitters was
+    // called
+    heavy_hitters *requestedTop;
+    heavy_hitters *expiredTop;
+
     //--- Auditing ---//
 
     // methods and data for auditing purposes, copied from homework 3
@@ -84,8 +214,8 @@ namespace reports
     static long long destructor_count ();
 
   private:
-    static long long constructor_calls;
-    static long long destructor_calls;
+    static std::atomic<long long> constructor_calls;
+    static std::atomic<long long> destructor_calls;
   };
 }
 